@@ -0,0 +1,157 @@
+#include "nbt.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+Compares how many times nbtRead, with and without the thread's pool or an intern table, nbtReadWith and nbtDocBuild call into the system allocator for the same document.
+Linked with -Wl,--wrap=malloc,--wrap=realloc (see CMakeLists.txt), so every malloc and realloc made by nbt.c passes through here first.
+
+usage: nbt-bench [file] [iterations]
+*/
+
+void* __real_malloc(size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static size_t system_allocations = 0;
+
+void* __wrap_malloc(size_t size) {
+	system_allocations++;
+	return __real_malloc(size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+	system_allocations++;
+	return __real_realloc(ptr, size);
+}
+
+static double seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** args) {
+	const char* path = argc > 1 ? args[1] : "out";
+	int iterations = argc > 2 ? atoi(args[2]) : 100;
+
+	FILE *f = fopen(path, "rb");
+	if(!f) {
+		printf("Could not open %s\n", path);
+		return 1;
+	}
+	fseek(f, 0L, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0L, SEEK_SET);
+	char* full = malloc(size);
+	fread(full, size, 1, f);
+	fclose(f);
+
+	// Default path, one malloc per name, string, array and list, and a realloc per compound growth
+	size_t before = system_allocations;
+	double start = seconds();
+	for(int i = 0; i < iterations; i++) {
+		tag t = nbtRead(full);
+		nbtFree(&t);
+	}
+	double malloc_time = seconds() - start;
+	size_t malloc_allocations = (system_allocations - before) / iterations;
+
+	// Default path again with this thread's pool on, after the first document every block comes back out of the pool
+	nbtPoolInit(SIZE_MAX);
+	before = system_allocations;
+	start = seconds();
+	for(int i = 0; i < iterations; i++) {
+		tag t = nbtRead(full);
+		nbtFree(&t);
+	}
+	double pool_time = seconds() - start;
+	size_t pool_allocations = system_allocations - before;
+	nbtPoolRelease();
+
+	// Default path with names shared through one intern table, only new names cost an allocation
+	nbt_intern table;
+	nbtInternInit(&table);
+	nbt_parser interned = {.intern = &table};
+	before = system_allocations;
+	start = seconds();
+	for(int i = 0; i < iterations; i++) {
+		tag t = nbtReadWith(&interned, full);
+		nbtFree(&t);
+	}
+	double intern_time = seconds() - start;
+	size_t intern_allocations = (system_allocations - before) / iterations;
+	size_t intern_names = table.count;
+	nbtInternRelease(&table);
+
+	// Arena path, the same arena is reset and reused for every document
+	nbt_arena arena;
+	nbtArenaInit(&arena, 0);
+	nbt_parser parser = {.arena = &arena};
+	size_t arena_allocations = 0;
+	before = system_allocations;
+	start = seconds();
+	for(int i = 0; i < iterations; i++) {
+		nbtArenaReset(&arena);
+		nbtReadWith(&parser, full);
+		arena_allocations = arena.allocations;
+	}
+	double arena_time = seconds() - start;
+	size_t arena_system_allocations = system_allocations - before;
+
+	// Arena path again, borrowing names, strings and byte arrays from the buffer
+	parser.flags = NBT_READ_BORROW;
+	size_t borrow_allocations = 0;
+	start = seconds();
+	for(int i = 0; i < iterations; i++) {
+		nbtArenaReset(&arena);
+		nbtReadWith(&parser, full);
+		borrow_allocations = arena.allocations;
+	}
+	double borrow_time = seconds() - start;
+
+	// Load and save again, as a pass-through would, with and without converting int and long arrays
+	char* copy = malloc(size);
+	double passthrough_time[2];
+	for(int lazy = 0; lazy < 2; lazy++) {
+		parser.flags = NBT_READ_BORROW | (lazy ? NBT_READ_LAZY_ARRAYS : 0);
+		start = seconds();
+		for(int i = 0; i < iterations; i++) {
+			nbtArenaReset(&arena);
+			nbtWrite(nbtReadWith(&parser, full), copy);
+		}
+		passthrough_time[lazy] = seconds() - start;
+	}
+	free(copy);
+	nbtArenaRelease(&arena);
+
+	// Compact document, every buffer is reused after the first build
+	nbt_doc doc = {0};
+	before = system_allocations;
+	start = seconds();
+	for(int i = 0; i < iterations; i++)
+		nbtDocBuild(&doc, full);
+	double doc_time = seconds() - start;
+	size_t doc_allocations = system_allocations - before;
+	size_t doc_memory = nbtDocMemory(&doc);
+	nbtDocRelease(&doc);
+
+	// Validation only, no allocation at all
+	before = system_allocations;
+	start = seconds();
+	for(int i = 0; i < iterations; i++)
+		nbtValidate(full, size);
+	double validate_time = seconds() - start;
+	size_t validate_allocations = system_allocations - before;
+
+	printf("%s: %zu bytes, %d iterations\n", path, size, iterations);
+	printf("nbtRead:          %zu system allocations per document, %.3f us per document\n", malloc_allocations, malloc_time * 1e6 / iterations);
+	printf("nbtRead, pooled:  %zu system allocations in total, %.3f us per document\n", pool_allocations, pool_time * 1e6 / iterations);
+	printf("nbtRead, interned: %zu system allocations per document, %.3f us per document, %zu distinct names\n", intern_allocations, intern_time * 1e6 / iterations, intern_names);
+	printf("nbtReadWith arena: %zu arena allocations per document, %zu system allocations in total, %.3f us per document\n", arena_allocations, arena_system_allocations, arena_time * 1e6 / iterations);
+	printf("nbtReadWith arena, borrowed: %zu arena allocations per document, %.3f us per document\n", borrow_allocations, borrow_time * 1e6 / iterations);
+	printf("read and write back, borrowed: %.3f us per document, with lazy arrays: %.3f us per document\n", passthrough_time[0] * 1e6 / iterations, passthrough_time[1] * 1e6 / iterations);
+	printf("nbtDocBuild:      %zu system allocations in total, %.3f us per document, %zu bytes (%.2fx serialized)\n", doc_allocations, doc_time * 1e6 / iterations, doc_memory, (double)doc_memory / size);
+	printf("nbtValidate:      %zu system allocations in total, %.3f us per document, %.0f MB/s\n", validate_allocations, validate_time * 1e6 / iterations, size * iterations / validate_time / 1e6);
+	free(full);
+}
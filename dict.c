@@ -0,0 +1,211 @@
+#include "nbt.h"
+#include <zlib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+Builds a zlib preset dictionary out of sample documents, for the small ones sent one at a time: item stacks, entities, single chunks.
+Every tag's header, its id and name, and every small tag whole are counted once for each document they turn up in. The pieces found in
+the most documents, weighed by their length, fill the dictionary, the best last where zlib reaches them with the shortest distances.
+Load it with setDictionary on nbt::deflater and nbt::inflater in gznbt.h.
+
+usage: nbt-dict [output] [size] [documents...]
+Documents can be gzipped or not, size is at most 32768
+*/
+
+#define DICT_PIECE 128 // Largest tag taken whole
+#define DICT_MAX 32768 // zlib's window, nothing further back is reachable
+
+typedef struct piece_t {
+	char* bytes;
+	uint32_t length;
+	uint32_t documents;
+	uint32_t last; // Last document that counted, so each counts once
+} piece;
+
+typedef struct pieces_t {
+	piece* slots;
+	size_t count, capacity;
+} pieces;
+
+static uint64_t hashBytes(const char* bytes, size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for(size_t i = 0; i < length; i++)
+		hash = (hash ^ (uint8_t)bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+static void countPiece(pieces* set, const char* bytes, size_t length, uint32_t document) {
+	if(set->count * 2 >= set->capacity) {
+		pieces grown = {calloc(set->capacity ? set->capacity * 2 : 4096, sizeof(piece)), set->count, set->capacity ? set->capacity * 2 : 4096};
+		for(size_t i = 0; i < set->capacity; i++) {
+			if(!set->slots[i].bytes)
+				continue;
+			size_t slot = hashBytes(set->slots[i].bytes, set->slots[i].length) & (grown.capacity - 1);
+			while(grown.slots[slot].bytes)
+				slot = (slot + 1) & (grown.capacity - 1);
+			grown.slots[slot] = set->slots[i];
+		}
+		free(set->slots);
+		*set = grown;
+	}
+	size_t slot = hashBytes(bytes, length) & (set->capacity - 1);
+	for(; set->slots[slot].bytes; slot = (slot + 1) & (set->capacity - 1)) {
+		piece* p = &set->slots[slot];
+		if(p->length == length && memcmp(p->bytes, bytes, length) == 0) {
+			if(p->last != document) {
+				p->documents++;
+				p->last = document;
+			}
+			return;
+		}
+	}
+	piece* p = &set->slots[slot];
+	p->bytes = malloc(length);
+	memcpy(p->bytes, bytes, length);
+	p->length = length;
+	p->documents = 1;
+	p->last = document;
+	set->count++;
+}
+
+/* Count t's header, unless it's a list element which has none, t whole if it's small, then everything inside it */
+static void collect(pieces* set, tag t, int element, uint32_t document, char* scratch) {
+	if(t.id == 0)
+		return;
+	if(!element) {
+		nbt_string name = nbtName(t);
+		scratch[0] = t.id;
+		scratch[1] = name.length >> 8;
+		scratch[2] = name.length;
+		memcpy(&scratch[3], name.data, name.length);
+		countPiece(set, scratch, 3 + name.length, document);
+	}
+	size_t size = nbtPeekLength(t);
+	if(size <= DICT_PIECE) {
+		// List elements are written with a header, but appear in documents without one
+		size_t skip = element ? 3 + t.name_length : 0;
+		nbtWrite(t, scratch);
+		if(size - skip >= 4)
+			countPiece(set, &scratch[skip], size - skip, document);
+	}
+	if(t.id == 9)
+		for(uint32_t i = 0; i < t.length; i++)
+			collect(set, t.payload.asList[i], 1, document, scratch);
+	if(t.id == 10)
+		for(uint32_t i = 0; i < t.length; i++)
+			collect(set, t.payload.asCompound[i], 0, document, scratch);
+}
+
+static int contains(const piece* outer, const piece* inner) {
+	for(size_t at = 0; at + inner->length <= outer->length; at++)
+		if(memcmp(&outer->bytes[at], inner->bytes, inner->length) == 0)
+			return 1;
+	return 0;
+}
+
+static uint64_t score(const piece* p) {
+	return (uint64_t)p->documents * p->length;
+}
+
+static int byScore(const void* a, const void* b) {
+	uint64_t x = score(a), y = score(b);
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* Read a whole file, inflating it if it's gzipped. Returns NULL if it can't be read */
+static char* readDocument(const char* path, size_t* size) {
+	gzFile file = gzopen(path, "rb");
+	if(!file)
+		return NULL;
+	size_t capacity = 65536;
+	char* bytes = malloc(capacity);
+	*size = 0;
+	int read;
+	while((read = gzread(file, &bytes[*size], (unsigned)(capacity - *size))) > 0) {
+		*size += read;
+		if(*size == capacity)
+			bytes = realloc(bytes, capacity *= 2);
+	}
+	gzclose(file);
+	if(read < 0) {
+		free(bytes);
+		return NULL;
+	}
+	return bytes;
+}
+
+int main(int argc, char** args) {
+	if(argc < 4) {
+		printf("usage: nbt-dict [output] [size] [documents...]\n");
+		return 1;
+	}
+	size_t size = atoi(args[2]);
+	if(size == 0 || size > DICT_MAX)
+		size = DICT_MAX;
+
+	pieces set = {0};
+	nbt_arena arena;
+	nbtArenaInit(&arena, 0);
+	nbt_parser parser = {.arena = &arena, .flags = NBT_READ_BORROW};
+	char* scratch = malloc(DICT_PIECE + 3 + 65535);
+	uint32_t documents = 0;
+	for(int i = 3; i < argc; i++) {
+		size_t length;
+		char* bytes = readDocument(args[i], &length);
+		if(!bytes || nbtValidate(bytes, length) < 0) {
+			printf("Skipping %s, not a readable document\n", args[i]);
+			free(bytes);
+			continue;
+		}
+		nbtArenaReset(&arena);
+		collect(&set, nbtReadWith(&parser, bytes), 0, ++documents, scratch);
+		free(bytes);
+	}
+	nbtArenaRelease(&arena);
+	free(scratch);
+
+	// Best first, keeping pieces seen in more than one document that aren't already inside one kept
+	piece* ranked = malloc(set.count * sizeof(piece));
+	size_t count = 0;
+	for(size_t i = 0; i < set.capacity; i++)
+		if(set.slots[i].bytes)
+			ranked[count++] = set.slots[i];
+	qsort(ranked, count, sizeof(piece), byScore);
+	size_t used = 0, kept = 0;
+	for(size_t i = 0; i < count && used < size; i++) {
+		piece* p = &ranked[i];
+		if((p->documents < 2 && documents > 1) || used + p->length > size)
+			continue;
+		int inside = 0;
+		for(size_t j = 0; j < kept && !inside; j++)
+			inside = contains(&ranked[j], p);
+		if(inside)
+			continue;
+		used += p->length;
+		ranked[kept++] = *p;
+	}
+
+	// Laid out back to front, so the best pieces end up last
+	char* dictionary = malloc(used ? used : 1);
+	size_t at = 0;
+	for(size_t i = kept; i-- > 0; at += ranked[i].length)
+		memcpy(&dictionary[at], ranked[i].bytes, ranked[i].length);
+	FILE* out = fopen(args[1], "wb");
+	if(!out) {
+		printf("Could not open %s\n", args[1]);
+		return 1;
+	}
+	fwrite(dictionary, 1, used, out);
+	fclose(out);
+	// The same id nbt::dictionaryId gives, and zlib streams compressed with it carry
+	uLong id = adler32(adler32(0, Z_NULL, 0), (const Bytef*)dictionary, (uInt)used);
+	printf("%s: %zu bytes, %zu pieces out of %zu, from %u documents, id %08lx\n", args[1], used, kept, count, documents, id);
+
+	for(size_t i = 0; i < set.capacity; i++)
+		free(set.slots[i].bytes);
+	free(set.slots);
+	free(ranked);
+	free(dictionary);
+}
@@ -3,23 +3,44 @@
 #include <stdio.h>
 
 int main(int argc, char** args) {
-	FILE *f = fopen("out", "rb");
-	fseek(f, 0L, SEEK_END);
-	size_t size = ftell(f);
-	fseek(f, 0L, SEEK_SET);
-	char* full = malloc(size);
-	fread(full, size, 1, f);
-	fclose(f);
-
-	tag t = nbtRead(full);
-	free(full);
+	// Map the file rather than reading it into a buffer, the parser copies everything it needs out of the mapping
+	nbt_parser parser = {0};
+	nbt_map map;
+	tag t;
+	if(nbtReadFile(&parser, "out", &map, &t) != NBT_OK) {
+		printf("Could not read out\n");
+		return 1;
+	}
+	nbtUnmapFile(&map);
 
-	printf("Read tag: %s\n", t.name);
+	printf("Read tag: %.*s\n", t.name_length, t.name);
 
-	size = nbtPeekLength(t);
-	full = malloc(size);
+	size_t size = nbtPeekLength(t);
+	char* full = malloc(size);
 	nbtWrite(t, full);
-	f = fopen("out2", "wb");
+	FILE* f = fopen("out2", "wb");
 	fwrite(full, size, 1, f);
 	fclose(f);
+
+	// An indexed compound read into a small arena, its children array moves out of a block that fits only the doubled capacity
+	nbt_writer writer;
+	nbtWriterInit(&writer);
+	nbtBeginCompound(&writer, "");
+	char name[2] = "a";
+	for(int i = 0; i < 9; i++, name[0]++)
+		nbtPutInt(&writer, name, i);
+	nbtEnd(&writer);
+	nbtWriterFinish(&writer);
+	nbt_arena arena;
+	nbtArenaInit(&arena, 400);
+	nbt_parser indexed = {.arena = &arena, .flags = NBT_READ_INDEX};
+	tag compound = nbtReadWith(&indexed, writer.buffer);
+	name[0] = 'a';
+	for(int i = 0; i < 9; i++, name[0]++)
+		if(nbtGet(compound, name).payload.asInt != i) {
+			printf("Indexed arena read lost %s\n", name);
+			return 1;
+		}
+	nbtArenaRelease(&arena);
+	nbtWriterRelease(&writer);
 }
@@ -1,6 +1,10 @@
 /*
 GZNBT is a small helper tool that interacts with zlib, and allows quick inflation and deflation of data, requires #define NBT_GZNBT_INCLUDE on first include
 Tailored for the NBT library
+
+Region chunks name their compression with a type byte, each type has a codec here: gzip, zlib, none, and LZ4.
+LZ4 is implemented in this file, in the block stream format Minecraft writes (lz4-java's LZ4BlockOutputStream), so nothing beyond zlib is needed.
+Small documents compress better with a preset dictionary shared by both ends, nbt-dict builds one out of sample documents.
 */
 
 
@@ -8,94 +12,735 @@ Tailored for the NBT library
 #include <zlib.h>
 #include <vector>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <atomic>
+#include <algorithm>
 #define NBT_CHUNK 16384
+// Windows inflateInto keeps in flight between its inflating thread and the sink
+#define NBT_WINDOWS 4
+// Uncompressed bytes in each member deflateParallel writes
+#define NBT_GZIP_MEMBER (1 << 20)
+
+// Compression types of region chunks, the same values as nbt.h
+#define NBT_COMPRESSION_GZIP 1
+#define NBT_COMPRESSION_ZLIB 2
+#define NBT_COMPRESSION_NONE 3
+#define NBT_COMPRESSION_LZ4 4
+
+// Uncompressed size of each LZ4 block, lz4-java's default
+#define NBT_LZ4_BLOCK 65536
+
 namespace nbt {
 	int deflate(char* in, size_t length, std::vector<char>* out, int level);
 	int inflate(char* in, size_t length, std::vector<char>* out);
+	// Like deflate, but with a zlib header and trailer instead of gzip's
+	int deflateZlib(char* in, size_t length, std::vector<char>* out, int level);
+	// LZ4 block stream compression, level is ignored. Returns Z_OK, or Z_DATA_ERROR for malformed input
+	int lz4Compress(char* in, size_t length, std::vector<char>* out, int level);
+	int lz4Decompress(char* in, size_t length, std::vector<char>* out);
+
+	// One chunk compression type. Both functions append to out and return Z_OK or a zlib error code
+	struct codec {
+		int type;
+		int (*compress)(char* in, size_t length, std::vector<char>* out, int level);
+		int (*decompress)(char* in, size_t length, std::vector<char>* out);
+	};
+	// The codec for a NBT_COMPRESSION_* type, or nullptr for types with none
+	const codec* getCodec(int type);
+	// Compress or decompress with the codec of a NBT_COMPRESSION_* type, Z_STREAM_ERROR for types with none
+	int compress(int type, char* in, size_t length, std::vector<char>* out, int level);
+	int decompress(int type, char* in, size_t length, std::vector<char>* out);
+
+	/*
+	A deflater or inflater keeps its zlib state between calls, resetting it instead of setting it up again for every buffer,
+	and writes straight into the output vector instead of through a temporary chunk. Keep one per thread when compressing
+	many small buffers like region chunks, nbt::deflate, deflateZlib and inflate already use one of each per thread.
+	*/
+	class deflater {
+	public:
+		// gzip framing, or zlib's when gzip is false
+		deflater(bool gzip = true);
+		~deflater();
+		deflater(const deflater&) = delete;
+		deflater& operator=(const deflater&) = delete;
+		// Append in, compressed at level, to out. Returns Z_OK or a zlib error code
+		int deflate(char* in, size_t length, std::vector<char>* out, int level);
+		// Start every stream from a copy of dictionary, none when length is 0. Only zlib framing can name a dictionary, gzip fails with Z_STREAM_ERROR
+		void setDictionary(const char* dictionary, size_t length);
+	private:
+		z_stream stream = {};
+		std::vector<char> dictionary;
+		bool gzip;
+		bool ready = false;
+		int level = Z_DEFAULT_COMPRESSION;
+	};
+	class inflater {
+	public:
+		inflater() = default;
+		~inflater();
+		inflater(const inflater&) = delete;
+		inflater& operator=(const inflater&) = delete;
+		// Append the inflated gzip or zlib stream to out, every member of a gzip one, room is made up front for hint bytes, or without one, the size in a gzip trailer.
+		// Returns Z_OK or a zlib error code
+		int inflate(char* in, size_t length, std::vector<char>* out, size_t hint = 0);
+		// Hand zlib streams that ask for it a copy of dictionary. Streams naming another dictionary fail with Z_DATA_ERROR
+		void setDictionary(const char* dictionary, size_t length);
+	private:
+		z_stream stream = {};
+		std::vector<char> dictionary;
+		bool ready = false;
+	};
+	// The id a zlib stream names its dictionary by, the Adler-32 of its bytes
+	uint32_t dictionaryId(const char* dictionary, size_t length);
+	// The id of the dictionary a zlib stream needs, or 0 if it needs none
+	uint32_t neededDictionary(const char* in, size_t length);
+
+	/*
+	Parallel gzip, for large files like structure and level exports.
+	deflateParallel cuts in into NBT_GZIP_MEMBER byte pieces and compresses them on threads threads at once, 0 for one per core,
+	as the members of a multi-member gzip file that any gzip reader takes. Each member's header carries its compressed size in an
+	extra field, "NB", so inflateParallel can find every member without inflating the ones before it, and inflate them all at once
+	straight into place. Anything else gzip or zlib, multi-member or not, inflateParallel inflates on this thread.
+	Both return Z_OK or a zlib error code
+	*/
+	int deflateParallel(char* in, size_t length, std::vector<char>* out, int level, unsigned threads = 0);
+	int inflateParallel(char* in, size_t length, std::vector<char>* out, unsigned threads = 0);
+
+	// Whether in starts with gzip's magic bytes
+	inline bool isGzip(const char* in, size_t length) {
+		return length >= 2 && (uint8_t)in[0] == 0x1f && (uint8_t)in[1] == 0x8b;
+	}
+
+	// Inflate the next window of at most NBT_CHUNK bytes. Returns Z_OK while more is to come, Z_STREAM_END after the last window, or an error.
+	// With gzip, a gzip member right after the end of the stream is inflated too
+	inline int inflateWindow(z_stream& stream, char* window, size_t& produced, bool gzip) {
+		stream.next_out = (Bytef*)window;
+		stream.avail_out = NBT_CHUNK;
+		int ret = ::inflate(&stream, Z_NO_FLUSH);
+		produced = NBT_CHUNK - stream.avail_out;
+		if (ret == Z_NEED_DICT)
+			return Z_DATA_ERROR;
+		// No progress with input left means the output was full, with none left the stream was cut short
+		if (ret == Z_BUF_ERROR)
+			return stream.avail_in ? Z_OK : Z_DATA_ERROR;
+		// Anything else after the end, like padding, is left alone as it always was
+		if (ret == Z_STREAM_END && gzip && isGzip((const char*)stream.next_in, stream.avail_in))
+			return inflateReset(&stream);
+		return ret;
+	}
+
+	/*
+	Inflate a gzip or zlib stream, every member of a gzip one, one NBT_CHUNK window at a time, handing each to sink.feed(bytes, length) as soon as it's ready, so the
+	whole inflated document never exists at once. nbt::loader is such a sink. With threaded, inflation runs on a thread of its own,
+	up to NBT_WINDOWS windows ahead of the sink. Stops once feed returns true, which the sink must do once it has everything it needs.
+	Returns Z_OK once it has, Z_DATA_ERROR if the stream ends first, like a document cut short, or another zlib error code.
+	Anything the sink throws is rethrown once the inflating thread has stopped
+	*/
+	template <typename Sink>
+	int inflateInto(char* in, size_t length, Sink& sink, bool threaded = false) {
+		z_stream stream = {};
+		int ret = inflateInit2(&stream, 32 | MAX_WBITS);
+		if (ret != Z_OK)
+			return ret;
+		stream.next_in = (Bytef*)in;
+		stream.avail_in = (uInt)length;
+		bool gzip = isGzip(in, length);
+		std::vector<char> windows(NBT_CHUNK * (threaded ? NBT_WINDOWS : 1));
+		size_t produced;
+		bool complete = false;
+
+		if (!threaded) {
+			do {
+				ret = inflateWindow(stream, &windows[0], produced, gzip);
+				if (ret != Z_OK && ret != Z_STREAM_END)
+					break;
+				if (produced && (complete = sink.feed(&windows[0], produced)))
+					break;
+			} while (ret != Z_STREAM_END);
+			(void)inflateEnd(&stream);
+			if (complete)
+				return Z_OK;
+			return ret == Z_STREAM_END || ret == Z_OK ? Z_DATA_ERROR : ret;
+		}
+
+		// Windows are filled in order and handed over through a ring, filled counts windows inflated and fed counts windows consumed
+		std::mutex lock;
+		std::condition_variable changed;
+		size_t sizes[NBT_WINDOWS];
+		size_t filled = 0, fed = 0;
+		bool finished = false, stop = false;
+		std::thread worker([&]() {
+			int result;
+			do {
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					changed.wait(guard, [&]() { return filled - fed < NBT_WINDOWS || stop; });
+					if (stop)
+						break;
+				}
+				size_t size;
+				result = inflateWindow(stream, &windows[(filled % NBT_WINDOWS) * NBT_CHUNK], size, gzip);
+				std::lock_guard<std::mutex> guard(lock);
+				sizes[filled % NBT_WINDOWS] = size;
+				filled++;
+				if (result != Z_OK) {
+					finished = true;
+					ret = result;
+				}
+				changed.notify_all();
+			} while (result == Z_OK);
+		});
+
+		std::exception_ptr thrown;
+		try {
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					changed.wait(guard, [&]() { return fed < filled || finished; });
+					if (fed == filled)
+						break;
+				}
+				size_t slot = fed % NBT_WINDOWS;
+				complete = sizes[slot] && sink.feed(&windows[slot * NBT_CHUNK], sizes[slot]);
+				std::lock_guard<std::mutex> guard(lock);
+				fed++;
+				changed.notify_all();
+				if (complete) {
+					stop = true;
+					break;
+				}
+			}
+		}
+		catch (...) {
+			thrown = std::current_exception();
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+			changed.notify_all();
+		}
+		worker.join();
+		(void)inflateEnd(&stream);
+		if (thrown)
+			std::rethrow_exception(thrown);
+		// Whatever the inflating thread ran into after the sink was done doesn't matter
+		if (complete)
+			return Z_OK;
+		return ret == Z_STREAM_END || ret == Z_OK ? Z_DATA_ERROR : ret;
+	}
 #ifdef NBT_GZNBT_INCLUDE
 #undef NBT_GZNBT_INCLUDE
-	int deflate(char* in, size_t length, std::vector<char>* out, int level) {
-		z_stream stream;
-		stream.zalloc = Z_NULL;
-		stream.zfree = Z_NULL;
-		stream.opaque = Z_NULL;
-		int ret = deflateInit2(&stream, level, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY);
-		int flush;
+	deflater::deflater(bool gzip) : gzip(gzip) {}
+	deflater::~deflater() {
+		if (ready)
+			(void)deflateEnd(&stream);
+	}
+	int deflater::deflate(char* in, size_t length, std::vector<char>* out, int level) {
+		int ret;
+		if (!ready) {
+			ret = deflateInit2(&stream, level, Z_DEFLATED, gzip ? 16 | MAX_WBITS : MAX_WBITS, 9, Z_DEFAULT_STRATEGY);
+			ready = ret == Z_OK;
+		}
+		else {
+			ret = deflateReset(&stream);
+			if (ret == Z_OK && level != this->level)
+				ret = deflateParams(&stream, level, Z_DEFAULT_STRATEGY);
+		}
+		if (ret == Z_OK && !dictionary.empty())
+			ret = deflateSetDictionary(&stream, (const Bytef*)&dictionary[0], (uInt)dictionary.size());
 		if (ret != Z_OK)
 			return ret;
-		size_t index = 0;
-		size_t outdex = 0;
-		do {
-			stream.avail_in = (uInt) std::min<size_t>(length, NBT_CHUNK);
+		this->level = level;
 
+		// deflateBound is almost always enough, so the output is usually sized once and trimmed once
+		size_t start = out->size(), end = start, index = 0;
+		out->resize(start + deflateBound(&stream, (uLong)std::min<size_t>(length, UINT_MAX)));
+		do {
+			if (end == out->size())
+				out->resize(end + std::max<size_t>(end - start, NBT_CHUNK));
+			size_t available = std::min<size_t>(length - index, UINT_MAX), space = std::min<size_t>(out->size() - end, UINT_MAX);
 			stream.next_in = (Bytef*)&in[index];
+			stream.avail_in = (uInt)available;
+			stream.next_out = (Bytef*)&(*out)[end];
+			stream.avail_out = (uInt)space;
+			ret = ::deflate(&stream, index + available == length ? Z_FINISH : Z_NO_FLUSH);
+			index += available - stream.avail_in;
+			end += space - stream.avail_out;
+		} while (ret == Z_OK);
+		out->resize(end);
+		return ret == Z_STREAM_END ? Z_OK : ret;
+	}
 
-			flush = (index + NBT_CHUNK > length) ? Z_FINISH : Z_NO_FLUSH;
+	inflater::~inflater() {
+		if (ready)
+			(void)inflateEnd(&stream);
+	}
+	// Expected inflated size, from the ISIZE field that ends a gzip stream, or a guess for zlib's.
+	// ISIZE is only trusted as far as deflate's best ratio, about 1032 to 1, could have produced it
+	static size_t inflateHint(const char* in, size_t length) {
+		if (length >= 18 && (uint8_t)in[0] == 0x1f && (uint8_t)in[1] == 0x8b) {
+			const uint8_t* trailer = (const uint8_t*)&in[length - 4];
+			size_t size = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (size_t)trailer[3] << 24;
+			if (size && size / 1032 <= length)
+				return size;
+		}
+		return length * 4;
+	}
+	int inflater::inflate(char* in, size_t length, std::vector<char>* out, size_t hint) {
+		int ret;
+		if (!ready) {
+			ret = inflateInit2(&stream, 32 | MAX_WBITS);
+			ready = ret == Z_OK;
+		}
+		else
+			ret = inflateReset(&stream);
+		if (ret != Z_OK)
+			return ret;
 
-			do {
-				stream.avail_out = NBT_CHUNK;
-				char* tmpOut = new char[NBT_CHUNK];
-				stream.next_out = (Bytef*)&tmpOut[0];
+		size_t start = out->size(), end = start, index = 0;
+		bool gzip = isGzip(in, length);
+		out->resize(start + (hint ? hint : inflateHint(in, length)));
+		do {
+			if (end == out->size())
+				out->resize(end + std::max<size_t>(end - start, NBT_CHUNK));
+			size_t available = std::min<size_t>(length - index, UINT_MAX), space = std::min<size_t>(out->size() - end, UINT_MAX);
+			stream.next_in = (Bytef*)&in[index];
+			stream.avail_in = (uInt)available;
+			stream.next_out = (Bytef*)&(*out)[end];
+			stream.avail_out = (uInt)space;
+			ret = ::inflate(&stream, Z_NO_FLUSH);
+			index += available - stream.avail_in;
+			end += space - stream.avail_out;
+			// inflateSetDictionary checks the stream's dictionary id itself
+			if (ret == Z_NEED_DICT && !dictionary.empty())
+				ret = inflateSetDictionary(&stream, (const Bytef*)&dictionary[0], (uInt)dictionary.size());
+			// Another gzip member follows, like the ones deflateParallel writes. Anything else after the end, like padding, is left alone
+			if (ret == Z_STREAM_END && gzip && isGzip(&in[index], length - index))
+				ret = inflateReset(&stream);
+		} while (ret == Z_OK);
+		out->resize(end);
+		// There's always room for output, so a buffer error means the input ran out before the stream ended
+		if (ret == Z_STREAM_END)
+			return Z_OK;
+		return ret == Z_BUF_ERROR || ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+	}
 
-				ret = deflate(&stream, flush);
+	void deflater::setDictionary(const char* dictionary, size_t length) {
+		this->dictionary.assign(dictionary, dictionary + length);
+	}
+	void inflater::setDictionary(const char* dictionary, size_t length) {
+		this->dictionary.assign(dictionary, dictionary + length);
+	}
+	uint32_t dictionaryId(const char* dictionary, size_t length) {
+		return (uint32_t)adler32(adler32(0, Z_NULL, 0), (const Bytef*)dictionary, (uInt)length);
+	}
+	uint32_t neededDictionary(const char* in, size_t length) {
+		// A zlib header is CMF and FLG, with bit 5 of FLG set the big endian id follows
+		const uint8_t* p = (const uint8_t*)in;
+		if (length < 6 || (p[0] & 0x0f) != Z_DEFLATED || (p[0] << 8 | p[1]) % 31 || !(p[1] & 0x20))
+			return 0;
+		return (uint32_t)p[2] << 24 | p[3] << 16 | p[4] << 8 | p[5];
+	}
 
-				out->insert(out->end(), &tmpOut[0], &tmpOut[NBT_CHUNK - stream.avail_out]);
-				delete[] tmpOut;
-			} while (stream.avail_out == 0);
-			
-			assert(stream.avail_in == 0);
+	int deflate(char* in, size_t length, std::vector<char>* out, int level) {
+		static thread_local deflater gzip(true);
+		return gzip.deflate(in, length, out, level);
+	}
+	int deflateZlib(char* in, size_t length, std::vector<char>* out, int level) {
+		static thread_local deflater zlib(false);
+		return zlib.deflate(in, length, out, level);
+	}
+	int inflate(char* in, size_t length, std::vector<char>* out) {
+		static thread_local inflater both;
+		return both.inflate(in, length, out);
+	}
 
-			index += NBT_CHUNK;
-		} while (flush != Z_FINISH);
-		assert(ret == Z_STREAM_END);
+	/*
+	Parallel gzip
+	A member is a 20 byte header, the raw deflate stream, then the CRC32 and size of its input. The header is gzip's 10 bytes with
+	FEXTRA set, then an 8 byte extra field holding one "NB" subfield: the whole member's size, little endian.
+	*/
+	static const size_t memberHeader = 20, memberTrailer = 8;
 
-		(void)deflateEnd(&stream);
-		return Z_OK;
+	static uint32_t getLE32(const uint8_t* p) {
+		return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+	static void putLE32(uint32_t v, char* out) {
+		out[0] = (char)v;
+		out[1] = (char)(v >> 8);
+		out[2] = (char)(v >> 16);
+		out[3] = (char)(v >> 24);
+	}
+	// Size of the member starting at in, from its "NB" subfield, or 0 if it has none or it doesn't fit in length
+	static size_t memberSize(const char* in, size_t length) {
+		const uint8_t* p = (const uint8_t*)in;
+		if (length < memberHeader + memberTrailer || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+			return 0;
+		size_t extra = p[10] | p[11] << 8;
+		if (12 + extra > length)
+			return 0;
+		for (size_t at = 12; at + 4 <= 12 + extra;) {
+			size_t field = p[at + 2] | p[at + 3] << 8;
+			if (at + 4 + field > 12 + extra)
+				return 0;
+			if (p[at] == 'N' && p[at + 1] == 'B' && field == 4) {
+				size_t size = getLE32(&p[at + 4]);
+				return size >= 12 + extra + memberTrailer && size <= length ? size : 0;
+			}
+			at += 4 + field;
+		}
+		return 0;
+	}
+	// Run worker(next) on threads threads, this one included, 0 for one per core but never more than count. Workers claim the items
+	// below count themselves, with next++
+	template <typename Worker>
+	static void runParallel(unsigned threads, size_t count, Worker worker) {
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned)std::max<size_t>(std::min<size_t>(threads, count), 1);
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (unsigned i = 1; i < threads; i++)
+			workers.emplace_back([&]() { worker(next); });
+		worker(next);
+		for (std::thread& t : workers)
+			t.join();
 	}
-	int inflate(char* in, size_t length, std::vector<char>* out) {
-		z_stream stream;
-		stream.zalloc = Z_NULL;
-		stream.zfree = Z_NULL;
-		stream.opaque = Z_NULL;
-		int ret = inflateInit2(&stream, 32 | MAX_WBITS);
-		if (ret != Z_OK)
-			return ret;
-		size_t index = 0;
-		size_t outdex = 0;
-		do {
-			stream.avail_in = (uInt)std::min<size_t>(length, NBT_CHUNK);
 
-			if (stream.avail_in == 0)
-				break;
+	int deflateParallel(char* in, size_t length, std::vector<char>* out, int level, unsigned threads) {
+		// Empty input still gets one, empty, member
+		size_t count = std::max<size_t>((length + NBT_GZIP_MEMBER - 1) / NBT_GZIP_MEMBER, 1);
+		std::vector<std::vector<char>> members(count);
+		std::vector<int> results(count, Z_OK);
+		runParallel(threads, count, [&](std::atomic<size_t>& next) {
+			z_stream stream = {};
+			int ret = deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY);
+			for (size_t i; (i = next++) < count;) {
+				if (ret != Z_OK) {
+					results[i] = ret;
+					continue;
+				}
+				size_t start = i * NBT_GZIP_MEMBER, size = std::min<size_t>(length - start, NBT_GZIP_MEMBER);
+				std::vector<char>& member = members[i];
+				// deflateBound is enough for the whole member in one call
+				size_t bound = deflateBound(&stream, (uLong)size);
+				member.resize(memberHeader + bound + memberTrailer);
+				stream.next_in = (Bytef*)&in[start];
+				stream.avail_in = (uInt)size;
+				stream.next_out = (Bytef*)&member[memberHeader];
+				stream.avail_out = (uInt)bound;
+				results[i] = ::deflate(&stream, Z_FINISH) == Z_STREAM_END ? Z_OK : Z_STREAM_ERROR;
+				size_t end = memberHeader + stream.total_out;
+				const char header[16] = {0x1f, (char)0x8b, 8, 4, 0, 0, 0, 0, 0, (char)255, 8, 0, 'N', 'B', 4, 0};
+				memcpy(&member[0], header, 16);
+				putLE32((uint32_t)(end + memberTrailer), &member[16]);
+				putLE32((uint32_t)crc32(0, (const Bytef*)&in[start], (uInt)size), &member[end]);
+				putLE32((uint32_t)size, &member[end + 4]);
+				member.resize(end + memberTrailer);
+				ret = deflateReset(&stream);
+			}
+			(void)deflateEnd(&stream);
+		});
+		for (int ret : results)
+			if (ret != Z_OK)
+				return ret;
+		size_t total = 0;
+		for (const std::vector<char>& member : members)
+			total += member.size();
+		out->reserve(out->size() + total);
+		for (const std::vector<char>& member : members)
+			out->insert(out->end(), member.begin(), member.end());
+		return Z_OK;
+	}
 
-			stream.next_in = (Bytef*)&in[index];
-			index += stream.avail_in;
-			do {
-				stream.avail_out = NBT_CHUNK;
-				char* tmpOut = new char[NBT_CHUNK];
-				stream.next_out = (Bytef*)&tmpOut[0];
+	int inflateParallel(char* in, size_t length, std::vector<char>* out, unsigned threads) {
+		// Where every member is, and where its output goes, from the sizes in each header and trailer
+		struct member {
+			size_t in, size, out, inflated;
+		};
+		std::vector<member> members;
+		size_t total = 0;
+		for (size_t at = 0; at < length;) {
+			size_t size = memberSize(&in[at], length - at);
+			// A size deflate's best ratio, about 1032 to 1, couldn't have produced isn't worth making room for
+			size_t inflated = size ? getLE32((const uint8_t*)&in[at + size - 4]) : 0;
+			if (size == 0 || inflated / 1032 > size) {
+				inflater serial;
+				return serial.inflate(in, length, out);
+			}
+			members.push_back({ at, size, total, inflated });
+			total += inflated;
+			at += size;
+		}
+		if (members.empty())
+			return Z_DATA_ERROR;
 
-				ret = inflate(&stream, Z_NO_FLUSH);
+		size_t start = out->size();
+		out->resize(start + total);
+		std::vector<int> results(members.size(), Z_OK);
+		runParallel(threads, members.size(), [&](std::atomic<size_t>& next) {
+			z_stream stream = {};
+			int ret = inflateInit2(&stream, 16 | MAX_WBITS);
+			for (size_t i; (i = next++) < members.size();) {
+				if (ret != Z_OK) {
+					results[i] = ret;
+					continue;
+				}
+				const member& m = members[i];
+				stream.next_in = (Bytef*)&in[m.in];
+				stream.avail_in = (uInt)m.size;
+				stream.next_out = (Bytef*)(out->data() + start + m.out);
+				stream.avail_out = (uInt)m.inflated;
+				// The member has to end exactly where its header said, having made exactly as much as its trailer said
+				int result = ::inflate(&stream, Z_FINISH);
+				if (result == Z_STREAM_END)
+					results[i] = stream.avail_in || stream.avail_out ? Z_DATA_ERROR : Z_OK;
+				else
+					results[i] = result == Z_MEM_ERROR ? result : Z_DATA_ERROR;
+				ret = inflateReset(&stream);
+			}
+			(void)inflateEnd(&stream);
+		});
+		for (int ret : results)
+			if (ret != Z_OK) {
+				out->resize(start);
+				return ret;
+			}
+		return Z_OK;
+	}
 
+	/*
+	LZ4
+	Blocks follow the LZ4 block format: sequences of literals then a match of 4 or more bytes up to 64KiB back, the last 5 bytes always literals.
+	The stream around them is lz4-java's: "LZ4Block", then per block a token (method | log2(block size) - 10), the compressed and
+	uncompressed sizes and an xxHash32 checksum of the uncompressed bytes, all little endian, ending with an empty block.
+	*/
+	static const char lz4Magic[8] = {'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k'};
+	static const uint8_t lz4MethodRaw = 0x10, lz4MethodLZ4 = 0x20;
+	static const uint32_t lz4Seed = 0x9747b28c;
 
-				assert(ret != Z_STREAM_ERROR);
+	static uint32_t lz4Read32(const uint8_t* p) {
+		return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+	static void lz4Write32(uint32_t v, std::vector<char>* out) {
+		char bytes[4] = {(char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24)};
+		out->insert(out->end(), bytes, bytes + 4);
+	}
+	static uint32_t lz4Rotate(uint32_t v, int r) {
+		return (v << r) | (v >> (32 - r));
+	}
+	static uint32_t xxHash32(const uint8_t* p, size_t length, uint32_t seed) {
+		const uint32_t p1 = 2654435761u, p2 = 2246822519u, p3 = 3266489917u, p4 = 668265263u, p5 = 374761393u;
+		const uint8_t* end = p + length;
+		uint32_t h;
+		if (length >= 16) {
+			uint32_t v[4] = {seed + p1 + p2, seed + p2, seed, seed - p1};
+			for (; p + 16 <= end; p += 16)
+				for (int i = 0; i < 4; i++)
+					v[i] = lz4Rotate(v[i] + lz4Read32(p + i * 4) * p2, 13) * p1;
+			h = lz4Rotate(v[0], 1) + lz4Rotate(v[1], 7) + lz4Rotate(v[2], 12) + lz4Rotate(v[3], 18);
+		}
+		else
+			h = seed + p5;
+		h += (uint32_t)length;
+		for (; p + 4 <= end; p += 4)
+			h = lz4Rotate(h + lz4Read32(p) * p3, 17) * p4;
+		for (; p < end; p++)
+			h = lz4Rotate(h + *p * p5, 11) * p1;
+		h ^= h >> 15;
+		h *= p2;
+		h ^= h >> 13;
+		h *= p3;
+		return h ^ (h >> 16);
+	}
 
-				switch (ret) {
-				case Z_NEED_DICT:
-					ret = Z_DATA_ERROR;
-				case Z_DATA_ERROR:
-				case Z_MEM_ERROR:
-					(void)inflateEnd(&stream);
-					return ret;
+	// Worst case size of an LZ4 block, when nothing matches
+	static size_t lz4Bound(size_t length) {
+		return length + length / 255 + 16;
+	}
+	// Write a length that didn't fit its 4 bit field, as 255s followed by the remainder
+	static uint8_t* lz4Length(uint8_t* op, size_t length) {
+		for (; length >= 255; length -= 255)
+			*op++ = 255;
+		*op++ = (uint8_t)length;
+		return op;
+	}
+	// Compress one block greedily, out needs lz4Bound(length) bytes. Returns the compressed size
+	static size_t lz4CompressBlock(const uint8_t* in, size_t length, uint8_t* out) {
+		const uint8_t* ip = in, * anchor = in, * end = in + length;
+		uint8_t* op = out;
+		// Matches must start 12 bytes before the end and stop 5 before it
+		if (length > 12) {
+			std::vector<uint32_t> table(1 << 12);
+			const uint8_t* match_limit = end - 5, * start_limit = end - 12;
+			while (ip < start_limit) {
+				uint32_t sequence = lz4Read32(ip);
+				uint32_t& slot = table[(sequence * 2654435761u) >> 20];
+				const uint8_t* ref = in + slot;
+				slot = (uint32_t)(ip - in);
+				if (ref >= ip || ip - ref > 65535 || lz4Read32(ref) != sequence) {
+					ip++;
+					continue;
+				}
+				const uint8_t* match_end = ip + 4;
+				for (const uint8_t* r = ref + 4; match_end < match_limit && *match_end == *r; r++)
+					match_end++;
+				while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+					ip--;
+					ref--;
 				}
+				size_t literals = ip - anchor, match = match_end - ip - 4;
+				uint8_t* token = op++;
+				*token = (uint8_t)((literals < 15 ? literals : 15) << 4 | (match < 15 ? match : 15));
+				if (literals >= 15)
+					op = lz4Length(op, literals - 15);
+				memcpy(op, anchor, literals);
+				op += literals;
+				*op++ = (uint8_t)(ip - ref);
+				*op++ = (uint8_t)((ip - ref) >> 8);
+				if (match >= 15)
+					op = lz4Length(op, match - 15);
+				ip = anchor = match_end;
+			}
+		}
+		size_t literals = end - anchor;
+		*op++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+		if (literals >= 15)
+			op = lz4Length(op, literals - 15);
+		memcpy(op, anchor, literals);
+		return op + literals - out;
+	}
+	// Decompress one block into exactly capacity bytes, checking every length and offset. Returns false for malformed blocks
+	static bool lz4DecompressBlock(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+		const uint8_t* ip = in, * end = in + length;
+		uint8_t* op = out, * out_end = out + capacity;
+		while (ip < end) {
+			uint8_t token = *ip++;
+			size_t literals = token >> 4;
+			if (literals == 15)
+				for (uint8_t b = 255; b == 255; literals += b) {
+					if (ip >= end)
+						return false;
+					b = *ip++;
+				}
+			if (literals > (size_t)(end - ip) || literals > (size_t)(out_end - op))
+				return false;
+			memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+			if (ip == end)
+				break;
+			if (end - ip < 2)
+				return false;
+			size_t offset = ip[0] | ip[1] << 8;
+			ip += 2;
+			if (offset == 0 || offset > (size_t)(op - out))
+				return false;
+			size_t match = token & 15;
+			if (match == 15)
+				for (uint8_t b = 255; b == 255; match += b) {
+					if (ip >= end)
+						return false;
+					b = *ip++;
+				}
+			match += 4;
+			if (match > (size_t)(out_end - op))
+				return false;
+			// Byte by byte, matches may overlap the bytes they produce
+			for (const uint8_t* ref = op - offset; match; match--)
+				*op++ = *ref++;
+		}
+		return op == out_end;
+	}
 
-				out->insert(out->end(), &tmpOut[0], &tmpOut[NBT_CHUNK - stream.avail_out]);
-				delete[] tmpOut;
-			} while (stream.avail_out == 0);
+	int lz4Compress(char* in, size_t length, std::vector<char>* out, int /*level*/) {
+		const int block_level = 6; // log2(NBT_LZ4_BLOCK) - 10
+		std::vector<char> block(lz4Bound(NBT_LZ4_BLOCK));
+		for (size_t index = 0; index < length; index += NBT_LZ4_BLOCK) {
+			size_t size = std::min<size_t>(length - index, NBT_LZ4_BLOCK);
+			const uint8_t* bytes = (const uint8_t*)in + index;
+			size_t compressed = lz4CompressBlock(bytes, size, (uint8_t*)&block[0]);
+			// Blocks that don't shrink are stored as they are
+			bool raw = compressed >= size;
+			out->insert(out->end(), lz4Magic, lz4Magic + 8);
+			out->push_back((char)((raw ? lz4MethodRaw : lz4MethodLZ4) | block_level));
+			lz4Write32((uint32_t)(raw ? size : compressed), out);
+			lz4Write32((uint32_t)size, out);
+			lz4Write32(xxHash32(bytes, size, lz4Seed) & 0xFFFFFFF, out);
+			if (raw)
+				out->insert(out->end(), (const char*)bytes, (const char*)bytes + size);
+			else
+				out->insert(out->end(), &block[0], &block[compressed]);
+		}
+		out->insert(out->end(), lz4Magic, lz4Magic + 8);
+		out->push_back((char)(lz4MethodRaw | block_level));
+		lz4Write32(0, out);
+		lz4Write32(0, out);
+		lz4Write32(0, out);
+		return Z_OK;
+	}
+	int lz4Decompress(char* in, size_t length, std::vector<char>* out) {
+		const uint8_t* ip = (const uint8_t*)in, * end = ip + length;
+		for (;;) {
+			if (end - ip < 21 || memcmp(ip, lz4Magic, 8) != 0)
+				return Z_DATA_ERROR;
+			uint8_t token = ip[8];
+			uint32_t compressed = lz4Read32(ip + 9), size = lz4Read32(ip + 13), checksum = lz4Read32(ip + 17);
+			ip += 21;
+			uint8_t method = token & 0xF0;
+			if ((method != lz4MethodRaw && method != lz4MethodLZ4) || size > (1u << ((token & 0x0F) + 10)) || compressed > (size_t)(end - ip))
+				return Z_DATA_ERROR;
+			if (size == 0)
+				return compressed == 0 ? Z_OK : Z_DATA_ERROR;
+			size_t start = out->size();
+			out->resize(start + size);
+			uint8_t* bytes = (uint8_t*)&(*out)[start];
+			if (method == lz4MethodRaw) {
+				if (compressed != size)
+					return Z_DATA_ERROR;
+				memcpy(bytes, ip, size);
+			}
+			else if (!lz4DecompressBlock(ip, compressed, bytes, size))
+				return Z_DATA_ERROR;
+			if ((xxHash32(bytes, size, lz4Seed) & 0xFFFFFFF) != checksum)
+				return Z_DATA_ERROR;
+			ip += compressed;
+		}
+	}
 
-		} while (ret != Z_STREAM_END);
-		(void)inflateEnd(&stream);
-		return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
+	static int storeCompress(char* in, size_t length, std::vector<char>* out, int /*level*/) {
+		out->insert(out->end(), in, in + length);
+		return Z_OK;
+	}
+	static int storeDecompress(char* in, size_t length, std::vector<char>* out) {
+		out->insert(out->end(), in, in + length);
+		return Z_OK;
+	}
+
+	// inflate tells gzip and zlib apart by their headers, so both decompress through it
+	static const codec codecs[] = {
+		{NBT_COMPRESSION_GZIP, deflate, inflate},
+		{NBT_COMPRESSION_ZLIB, deflateZlib, inflate},
+		{NBT_COMPRESSION_NONE, storeCompress, storeDecompress},
+		{NBT_COMPRESSION_LZ4, lz4Compress, lz4Decompress},
+	};
+	const codec* getCodec(int type) {
+		for (const codec& c : codecs)
+			if (c.type == type)
+				return &c;
+		return nullptr;
+	}
+	int compress(int type, char* in, size_t length, std::vector<char>* out, int level) {
+		const codec* c = getCodec(type);
+		return c ? c->compress(in, length, out, level) : Z_STREAM_ERROR;
+	}
+	int decompress(int type, char* in, size_t length, std::vector<char>* out) {
+		const codec* c = getCodec(type);
+		return c ? c->decompress(in, length, out) : Z_STREAM_ERROR;
 	}
 #endif
 }
\ No newline at end of file
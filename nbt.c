@@ -2,6 +2,15 @@
 #include <endian.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <time.h>
+#include <dirent.h>
 
 #define NBT_LITTLE_ENDIAN 0
 #define NBT_BIG_ENDIAN 1
@@ -38,7 +47,7 @@ static void set_endianness() {
 #endif
 
 
-/* Functions to read primitives from bytes */
+/* Functions to read primitives from bytes in the default byte order */
 static int16_t readInt16(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -54,26 +63,6 @@ static int16_t readInt16(const char* const bytes) {
 #endif
 }
 
-static void writeInt16(int16_t v, char* bytes) {
-#if NBT_HOST_ENDIAN == -1
-	if(host_endian == -1)
-		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(int16_t*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[1];
-		bytes[1] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(int16_t*)bytes = v;
-#else
-	char* b = (char*)&v;
-	bytes[0] = b[1];
-	bytes[1] = b[0];
-#endif
-}
-
 static uint16_t readUInt16(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -89,26 +78,6 @@ static uint16_t readUInt16(const char* const bytes) {
 #endif
 }
 
-static void writeUInt16(uint16_t v, char* bytes) {
-#if NBT_HOST_ENDIAN == -1
-	if(host_endian == -1)
-		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(uint16_t*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[1];
-		bytes[1] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(uint16_t*)bytes = v;
-#else
-	char* b = (char*)&v;
-	bytes[0] = b[1];
-	bytes[1] = b[0];
-#endif
-}
-
 static int32_t readInt32(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -124,31 +93,6 @@ static int32_t readInt32(const char* const bytes) {
 #endif
 }
 
-static void writeInt32(int32_t v, char* bytes) {
-#if NBT_HOST_ENDIAN == -1
-	if(host_endian == -1)
-		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(int32_t*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[3];
-		bytes[1] = b[2];
-		bytes[2] = b[1];
-		bytes[3] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(int32_t*)bytes = v;
-#else
-	char* b = (char*)&v;
-	bytes[0] = b[3];
-	bytes[1] = b[2];
-	bytes[2] = b[1];
-	bytes[3] = b[0];
-#endif
-}
-
-
 static uint32_t readUInt32(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -164,30 +108,6 @@ static uint32_t readUInt32(const char* const bytes) {
 #endif
 }
 
-static void writeUInt32(uint32_t v, char* bytes) {
-#if NBT_HOST_ENDIAN == -1
-	if(host_endian == -1)
-		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(uint32_t*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[3];
-		bytes[1] = b[2];
-		bytes[2] = b[1];
-		bytes[3] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(uint32_t*)bytes = v;
-#else
-	char* b = (char*)&v;
-	bytes[0] = b[3];
-	bytes[1] = b[2];
-	bytes[2] = b[1];
-	bytes[3] = b[0];
-#endif
-}
-
 static int64_t readInt64(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -203,38 +123,6 @@ static int64_t readInt64(const char* const bytes) {
 #endif
 }
 
-static void writeInt64(int64_t v, char* bytes) {
-#if NBT_HOST_ENDIAN == -1
-	if(host_endian == -1)
-		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(int64_t*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[7];
-		bytes[1] = b[6];
-		bytes[2] = b[5];
-		bytes[3] = b[4];
-		bytes[4] = b[3];
-		bytes[5] = b[2];
-		bytes[6] = b[1];
-		bytes[7] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(int64_t*)bytes = v;
-#else
-	char* b = (char*)&v;
-	bytes[0] = b[7];
-	bytes[1] = b[6];
-	bytes[2] = b[5];
-	bytes[3] = b[4];
-	bytes[4] = b[3];
-	bytes[5] = b[2];
-	bytes[6] = b[1];
-	bytes[7] = b[0];
-#endif
-}
-
 static _Float32 readFloat32(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
@@ -250,260 +138,3530 @@ static _Float32 readFloat32(const char* const bytes) {
 #endif
 }
 
-static void writeFloat32(_Float32 v, char* bytes) {
+static _Float64 readFloat64(const char* const bytes) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
 		set_endianness();
 	if(host_endian == NBT_ENDIANNESS)
-		*(_Float32*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[3];
-		bytes[1] = b[2];
-		bytes[2] = b[1];
-		bytes[3] = b[0];
-	}
+		return *(_Float64*)bytes;
+	else
+		return *(_Float64*)(char[8]){bytes[7], bytes[6], bytes[5], bytes[4], bytes[3], bytes[2], bytes[1], bytes[0]};
 #elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(_Flat32*)bytes = v;
+	return *(_Float64*)bytes;
 #else
-	char* b = (char*)&v;
-	bytes[0] = b[3];
-	bytes[1] = b[2];
-	bytes[2] = b[1];
-	bytes[3] = b[0];
+	return *(_Float64*)(char[8]){bytes[7], bytes[6], bytes[5], bytes[4], bytes[3], bytes[2], bytes[1], bytes[0]};
+#endif
+}
+
+/*
+Bulk byte swapping for int and long arrays
+Each kernel reverses the bytes of every width-sized element from src into dst (which may be the same buffer).
+SSSE3 and AVX2 versions are picked at runtime when the CPU has them, anything left over is handled by the scalar loop.
+*/
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NBT_X86_SWAP
+#include <immintrin.h>
+#endif
+
+static void nbtSwapScalar(char* dst, const char* src, size_t count, int width) {
+	switch(width) {
+		case 2:
+			for(size_t i = 0; i < count; i++, dst += 2, src += 2) {
+				uint16_t v;
+				memcpy(&v, src, 2);
+				v = (uint16_t)(v << 8 | v >> 8);
+				memcpy(dst, &v, 2);
+			}
+			break;
+		case 4:
+			for(size_t i = 0; i < count; i++, dst += 4, src += 4) {
+				uint32_t v;
+				memcpy(&v, src, 4);
+				v = __builtin_bswap32(v);
+				memcpy(dst, &v, 4);
+			}
+			break;
+		case 8:
+			for(size_t i = 0; i < count; i++, dst += 8, src += 8) {
+				uint64_t v;
+				memcpy(&v, src, 8);
+				v = __builtin_bswap64(v);
+				memcpy(dst, &v, 8);
+			}
+			break;
+	}
+}
+
+#ifdef NBT_X86_SWAP
+__attribute__((target("ssse3")))
+static void nbtSwapSSSE3(char* dst, const char* src, size_t count, int width) {
+	char order[16];
+	for(int i = 0; i < 16; i++)
+		order[i] = i / width * width + width - 1 - i % width;
+	const __m128i mask = _mm_loadu_si128((const __m128i*)order);
+	size_t bytes = count * width, i = 0;
+	for(; i + 16 <= bytes; i += 16)
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), mask));
+	nbtSwapScalar(dst + i, src + i, (bytes - i) / width, width);
+}
+
+__attribute__((target("avx2")))
+static void nbtSwapAVX2(char* dst, const char* src, size_t count, int width) {
+	char order[32];
+	for(int i = 0; i < 32; i++)
+		order[i] = (i & 15) / width * width + width - 1 - i % width; // vpshufb shuffles within each 128 bit lane
+	const __m256i mask = _mm256_loadu_si256((const __m256i*)order);
+	size_t bytes = count * width, i = 0;
+	for(; i + 64 <= bytes; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+		_mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+	}
+	for(; i + 32 <= bytes; i += 32)
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), mask));
+	nbtSwapScalar(dst + i, src + i, (bytes - i) / width, width);
+}
 #endif
+
+static void (*nbtSwapKernel)(char*, const char*, size_t, int) = NULL;
+static pthread_once_t nbtSwapPicked = PTHREAD_ONCE_INIT;
+
+/* Picked once for the process, lists decoded on several threads may all get here first */
+static void nbtSwapPick(void) {
+	nbtSwapKernel = nbtSwapScalar;
+#ifdef NBT_X86_SWAP
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		nbtSwapKernel = nbtSwapAVX2;
+	else if(__builtin_cpu_supports("ssse3"))
+		nbtSwapKernel = nbtSwapSSSE3;
+#endif
+}
+
+static void nbtSwap(void* dst, const void* src, size_t count, int width) {
+	pthread_once(&nbtSwapPicked, nbtSwapPick);
+	nbtSwapKernel(dst, src, count, width);
+}
+
+void nbtByteSwap16(void* dst, const void* src, size_t count) {
+	nbtSwap(dst, src, count, 2);
+}
+
+void nbtByteSwap32(void* dst, const void* src, size_t count) {
+	nbtSwap(dst, src, count, 4);
+}
+
+void nbtByteSwap64(void* dst, const void* src, size_t count) {
+	nbtSwap(dst, src, count, 8);
 }
 
-static int64_t readFloat64(const char* const bytes) {
+/* Copy an array of count width-sized elements between NBT byte order and host byte order, works in either direction */
+static void convertArray(void* dst, const void* src, size_t count, int width) {
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
 		set_endianness();
 	if(host_endian == NBT_ENDIANNESS)
-		return *(_Float64*)bytes;
+		memcpy(dst, src, count * width);
 	else
-		return *(_Float64*)(char[8]){bytes[7], bytes[6], bytes[5], bytes[4], bytes[3], bytes[2], bytes[1], bytes[0]};
+		nbtSwap(dst, src, count, width);
 #elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	return *(_Float64*)bytes;
+	memcpy(dst, src, count * width);
 #else
-	return *(_Float64*)(char[8]){bytes[7], bytes[6], bytes[5], bytes[4], bytes[3], bytes[2], bytes[1], bytes[0]};
+	nbtSwap(dst, src, count, width);
 #endif
 }
 
-static void writeFloat64(_Float64 v, char* bytes) {
+/*
+Byte order chosen at runtime
+The primitives below take a format, and everything that walks a document is instantiated once per format (see nbtReadPayloadBig and friends).
+Inside an instantiation the format is a constant, so these fold down to a plain load or a bswap, and the format is only looked at once per call.
+*/
+#define NBT_INLINE static inline __attribute__((always_inline))
+
+/* Resolve NBT_FORMAT_DEFAULT to the byte order the library was built for */
+static int nbtFormat(int format) {
+	if(format == NBT_FORMAT_DEFAULT)
+		return NBT_ENDIANNESS == NBT_LITTLE_ENDIAN ? NBT_FORMAT_LITTLE : NBT_FORMAT_BIG;
+	return format;
+}
+
+/* Whether a format stores fixed size numbers the same way the host does, the network format's are little endian */
+NBT_INLINE int nbtNative(const int format) {
+	const int order = format == NBT_FORMAT_BIG ? NBT_BIG_ENDIAN : NBT_LITTLE_ENDIAN;
 #if NBT_HOST_ENDIAN == -1
 	if(host_endian == -1)
 		set_endianness();
-	if(host_endian == NBT_ENDIANNESS)
-		*(_Float64*)bytes = v;
-	else {
-		char* b = (char*)&v;
-		bytes[0] = b[7];
-		bytes[1] = b[6];
-		bytes[2] = b[5];
-		bytes[3] = b[4];
-		bytes[4] = b[3];
-		bytes[5] = b[2];
-		bytes[6] = b[1];
-		bytes[7] = b[0];
-	}
-#elif NBT_HOST_ENDIAN == NBT_ENDIANNESS
-	*(_Float64*)bytes = v;
+	return host_endian == order;
 #else
-	char* b = (char*)&v;
-	bytes[0] = b[7];
-	bytes[1] = b[6];
-	bytes[2] = b[5];
-	bytes[3] = b[4];
-	bytes[4] = b[3];
-	bytes[5] = b[2];
-	bytes[6] = b[1];
-	bytes[7] = b[0];
+	return NBT_HOST_ENDIAN == order;
 #endif
 }
 
-/* Return a tag based on a compound tag or payload and name */
-tag nbtPayloadGet(const tag* const compound, int8_t compound_length, const char* const name) {
-	for(int i = 0; i < compound_length; i++)
-		if(strcmp(name, compound[i].name) == 0)
-			return compound[i];
-	return (tag){0};
+NBT_INLINE uint16_t getUInt16(const char* bytes, const int format) {
+	uint16_t v;
+	memcpy(&v, bytes, 2);
+	return nbtNative(format) ? v : (uint16_t)(v << 8 | v >> 8);
 }
 
-tag nbtGet(tag compoundTag, const char* const name) {
-	return nbtPayloadGet(compoundTag.payload.asCompound, compoundTag.length, name);
+NBT_INLINE uint32_t getUInt32(const char* bytes, const int format) {
+	uint32_t v;
+	memcpy(&v, bytes, 4);
+	return nbtNative(format) ? v : __builtin_bswap32(v);
 }
 
-const char* nbtReadInto(tag* destination, const char* bytes);
+NBT_INLINE uint64_t getUInt64(const char* bytes, const int format) {
+	uint64_t v;
+	memcpy(&v, bytes, 8);
+	return nbtNative(format) ? v : __builtin_bswap64(v);
+}
 
-const char* nbtReadPayload(int8_t type, uint32_t* length, union payload* payload, const char* bytes) {
-	switch(type) {
-		case 1:
-			payload->asByte = bytes[0];
-			*length = 1;
-			break;
-		case 2:
-			payload->asShort = readInt16(bytes);
-			*length = 2;
-			break;
-		case 3:
-			payload->asInt = readInt32(bytes);
-			*length = 4;
-			break;
-		case 4:
-			payload->asInt = readInt64(bytes);
-			*length = 8;
-			break;
-		case 5:
-			payload->asInt = readFloat32(bytes);
-			*length = 4;
+NBT_INLINE void putUInt16(uint16_t v, char* bytes, const int format) {
+	if(!nbtNative(format))
+		v = (uint16_t)(v << 8 | v >> 8);
+	memcpy(bytes, &v, 2);
+}
+
+NBT_INLINE void putUInt32(uint32_t v, char* bytes, const int format) {
+	if(!nbtNative(format))
+		v = __builtin_bswap32(v);
+	memcpy(bytes, &v, 4);
+}
+
+NBT_INLINE void putUInt64(uint64_t v, char* bytes, const int format) {
+	if(!nbtNative(format))
+		v = __builtin_bswap64(v);
+	memcpy(bytes, &v, 8);
+}
+
+NBT_INLINE _Float32 getFloat32(const char* bytes, const int format) {
+	uint32_t bits = getUInt32(bytes, format);
+	_Float32 v;
+	memcpy(&v, &bits, 4);
+	return v;
+}
+
+NBT_INLINE _Float64 getFloat64(const char* bytes, const int format) {
+	uint64_t bits = getUInt64(bytes, format);
+	_Float64 v;
+	memcpy(&v, &bits, 8);
+	return v;
+}
+
+NBT_INLINE void putFloat32(_Float32 v, char* bytes, const int format) {
+	uint32_t bits;
+	memcpy(&bits, &v, 4);
+	putUInt32(bits, bytes, format);
+}
+
+NBT_INLINE void putFloat64(_Float64 v, char* bytes, const int format) {
+	uint64_t bits;
+	memcpy(&bits, &v, 8);
+	putUInt64(bits, bytes, format);
+}
+
+/* convertArray for a format picked at runtime */
+NBT_INLINE void convertArrayFormat(void* dst, const void* src, size_t count, int width, const int format) {
+	if(nbtNative(format))
+		memcpy(dst, src, count * width);
+	else
+		nbtSwap(dst, src, count, width);
+}
+
+/*
+Variable length integers of the network format, 7 bits at a time with the lowest group first and the top bit set on every byte but the last.
+Ints, longs and the lengths of lists and arrays are zigzag encoded first so small negative numbers stay short, name and string lengths are not.
+The get* readers trust their input like the rest of the reader, nbtSkipVarInt is the bounds checked version.
+*/
+#define NBT_VARINT32_MAX 5
+#define NBT_VARINT64_MAX 10
+
+NBT_INLINE const char* getVarUInt32(const char* bytes, uint32_t* out) {
+	uint32_t v = 0;
+	for(int shift = 0; shift < 35; shift += 7) {
+		uint8_t b = *bytes++;
+		v |= (uint32_t)(b & 0x7f) << shift;
+		if(!(b & 0x80))
 			break;
-		case 6:
-			payload->asInt = readFloat64(bytes);
-			*length = 8;
+	}
+	*out = v;
+	return bytes;
+}
+
+NBT_INLINE const char* getVarUInt64(const char* bytes, uint64_t* out) {
+	uint64_t v = 0;
+	for(int shift = 0; shift < 70; shift += 7) {
+		uint8_t b = *bytes++;
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if(!(b & 0x80))
 			break;
-		case 7:
-			*length = readUInt32(bytes);
-			payload->asBytes = malloc(*length);
-			bytes += 4;
-			for(int i = 0; i < *length; i++, bytes++)
-				payload->asBytes[i] = *bytes;
-			return bytes;
-		case 8:
-			*length = readUInt16(bytes);
-			payload->asString = malloc(*length + 1);
-			bytes += 2;
-			for(int i = 0; i < *length; i++, bytes++)
-				payload->asString[i] = *bytes;
-			payload->asString[*length] = 0;
-			return bytes;
-		case 9:
-			type = bytes[0];
-			*length = readUInt32(bytes+1);
-			payload->asList = malloc(*length * sizeof(tag));
-			bytes += 5;
-			for(uint32_t i = 0; i < *length; i++) { // define "sublength" so something can be passed for length
-				payload->asList[i].name_length = 0;
-				payload->asList[i].name = NULL;
-				payload->asList[i].id = type;
-				bytes = nbtReadPayload(type, &payload->asList[i].length, &payload->asList[i].payload, bytes);
-			}
-			return bytes;
-		case 10:
-			*length = 0;
-			payload->asCompound = NULL;
-			while(bytes[0] != 0) {
-				if(*length == 0)
-					payload->asCompound = malloc(++*length * sizeof(tag));
-				else
-					payload->asCompound = realloc(payload->asCompound, ++*length * sizeof(tag));
-				bytes = nbtReadInto(payload->asCompound + *length - 1, bytes);
-			}
-			return bytes + 1;
-		case 11:
-			*length = readUInt32(bytes);
-			payload->asInts = malloc(*length * 4);
-			bytes += 4;
-			for(int i = 0; i < *length; i++, bytes+=4)
-				payload->asInts[i] = readInt32(bytes);
-			return bytes;
-		case 12:
-			*length = readUInt32(bytes);
-			payload->asBytes = malloc(*length * 8);
-			bytes += 4;
-			for(int i = 0; i < *length; i++, bytes+=8)
-				payload->asBytes[i] = readInt64(bytes);
-			return bytes;
 	}
-	return bytes + *length;
+	*out = v;
+	return bytes;
 }
 
-const char* nbtReadInto(tag* tag, const char* bytes) {
-	tag->id = bytes[0];
-	tag->name_length = readUInt16(bytes + 1);
-	tag->name = malloc(tag->name_length);
-	memcpy(tag->name, bytes+3, tag->name_length);
-	tag->name[tag->name_length] = 0;
-	bytes += 3 + tag->name_length;
+NBT_INLINE char* putVarUInt64(uint64_t v, char* bytes) {
+	while(v >= 0x80) {
+		*bytes++ = (char)(v | 0x80);
+		v >>= 7;
+	}
+	*bytes++ = (char)v;
+	return bytes;
+}
 
-	// Read payload for respective tag types
-	return nbtReadPayload(tag->id, &tag->length, &tag->payload, bytes);
+static size_t nbtVarUIntSize(uint64_t v) {
+	size_t size = 1;
+	while(v >= 0x80) {
+		v >>= 7;
+		size++;
+	}
+	return size;
 }
 
-tag nbtRead(const char* bytes) {
-	tag tag = {0};
-	nbtReadInto(&tag, bytes);
-	return tag;
+NBT_INLINE uint32_t zigzag32(int32_t v) {
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
 }
 
-char* nbtWritePayload(int8_t id, union payload payload, int32_t length, char* bytes) {
-	switch (id) {
-		default:
-			memcpy(bytes, payload.asBytes, length);
-			return bytes + length;
-		case 7:
-			writeUInt32(length, bytes);
-			bytes += 4;
-			memcpy(bytes, payload.asBytes, length);
-			return bytes + length;
-		case 8:
-			writeUInt16(length, bytes);
-			bytes += 2;
-			memcpy(bytes, payload.asBytes, length);
-			return bytes + length;
-		case 9:
-			bytes[0] = length == 0 ? 0 : payload.asList[0].id;
-			writeUInt32(length, bytes+1);
-			bytes += 5;
-			for(int i = 0; i < length; i++)
-				bytes = nbtWritePayload(payload.asList[i].id, payload.asList[i].payload, payload.asList[i].length, bytes);
-			return bytes;
-		case 10:
-			for(int i = 0; i < length; i++)
-				bytes = nbtWrite(payload.asCompound[i], bytes);
-			bytes[0] = 0;
-			return bytes + 1;
-		case 11:
-			writeUInt32(length, bytes);
-			bytes += 4;
-			memcpy(bytes, payload.asBytes, length*4);
-			return bytes + length*4;
-		case 12:
-			writeUInt32(length, bytes);
-			bytes += 4;
-			memcpy(bytes, payload.asBytes, length*8);
-			return bytes + length*8;
+NBT_INLINE int32_t unzigzag32(uint32_t v) {
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+NBT_INLINE uint64_t zigzag64(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+NBT_INLINE int64_t unzigzag64(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* Skip a varint of at most max bytes at offset, checking it against the buffer size */
+static int nbtSkipVarInt(const char* bytes, size_t size, size_t* offset, int max, uint64_t* out) {
+	uint64_t v = 0;
+	for(int i = 0; i < max; i++) {
+		if(*offset >= size)
+			return NBT_ERROR_TRUNCATED;
+		uint8_t b = bytes[(*offset)++];
+		v |= (uint64_t)(b & 0x7f) << (7 * i);
+		if(!(b & 0x80)) {
+			*out = v;
+			return max == NBT_VARINT32_MAX && v > UINT32_MAX ? NBT_ERROR_TOO_LARGE : NBT_OK;
+		}
 	}
+	return NBT_ERROR_TOO_LARGE;
+}
 
+/*
+Fields whose encoding depends on the format, each returns the bytes after the field.
+Lengths of names and strings are 16 bit in the fixed formats, lengths of lists and arrays ("counts") 32 bit.
+*/
+NBT_INLINE const char* getStringLength(const char* bytes, uint32_t* length, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return getVarUInt32(bytes, length);
+	*length = getUInt16(bytes, format);
+	return bytes + 2;
 }
 
-char* nbtWrite(tag t, char* bytes) {
-	// Write id, name length, and name
-	*bytes = t.id;
-	writeUInt16(t.name_length, ++bytes);
-	memcpy(bytes + 2, t.name, t.name_length);
-	bytes+=2+t.name_length;
+NBT_INLINE const char* getCount(const char* bytes, uint32_t* length, const int format) {
+	if(format == NBT_FORMAT_VARINT) {
+		bytes = getVarUInt32(bytes, length);
+		*length = unzigzag32(*length);
+		return bytes;
+	}
+	*length = getUInt32(bytes, format);
+	return bytes + 4;
+}
 
-	// Different types of payloads
-	return nbtWritePayload(t.id, t.payload, t.length, bytes);
+NBT_INLINE const char* getInt32(const char* bytes, int32_t* out, const int format) {
+	if(format == NBT_FORMAT_VARINT) {
+		uint32_t v;
+		bytes = getVarUInt32(bytes, &v);
+		*out = unzigzag32(v);
+		return bytes;
+	}
+	*out = (int32_t)getUInt32(bytes, format);
+	return bytes + 4;
 }
 
-size_t nbtPeekLength(tag t) {
-	// id + short(name_length) + name_length string(name) + payload size
-	size_t out = 1 + 2 + t.name_length;
-	switch (t.id) {
-		default: return out + t.length;
-		case 7: return out + t.length + 4;
-		case 8: return out + t.length + 2;
-		case 9: 
-			for(int i = 0; i < t.length; i++)
-				out += nbtPeekLength(t.payload.asList[i]) - 3 - t.payload.asList[i].name_length;
-			return out + 5;
-		case 11: return out + t.length * 4 + 4;
-		case 12: return out + t.length * 8 + 4;
-		case 10:
-			for(int i = 0; i < t.length; i++)
-				out += nbtPeekLength(t.payload.asCompound[i]);
-			return out+1;
+NBT_INLINE const char* getInt64(const char* bytes, int64_t* out, const int format) {
+	if(format == NBT_FORMAT_VARINT) {
+		uint64_t v;
+		bytes = getVarUInt64(bytes, &v);
+		*out = unzigzag64(v);
+		return bytes;
+	}
+	*out = (int64_t)getUInt64(bytes, format);
+	return bytes + 8;
+}
+
+NBT_INLINE char* putStringLength(uint32_t length, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return putVarUInt64(length, bytes);
+	putUInt16(length, bytes, format);
+	return bytes + 2;
+}
+
+NBT_INLINE char* putCount(uint32_t length, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return putVarUInt64(zigzag32(length), bytes);
+	putUInt32(length, bytes, format);
+	return bytes + 4;
+}
+
+NBT_INLINE char* putInt32(int32_t v, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return putVarUInt64(zigzag32(v), bytes);
+	putUInt32(v, bytes, format);
+	return bytes + 4;
+}
+
+NBT_INLINE char* putInt64(int64_t v, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return putVarUInt64(zigzag64(v), bytes);
+	putUInt64(v, bytes, format);
+	return bytes + 8;
+}
+
+/* Size of payloads that don't carry their own length, 0 for types that do */
+static size_t nbtFixedSize(int8_t type) {
+	switch(type) {
+		case 1: return 1;
+		case 2: return 2;
+		case 3: return 4;
+		case 4: return 8;
+		case 5: return 4;
+		case 6: return 8;
 	}
+	return 0;
 }
 
+/* nbtFixedSize for a format, ints and longs are variable length in the network format */
+NBT_INLINE size_t nbtFixedSizeFormat(int8_t type, const int format) {
+	if(format == NBT_FORMAT_VARINT && (type == 3 || type == 4))
+		return 0;
+	return nbtFixedSize(type);
+}
+
+/*
+Arrays read with NBT_READ_LAZY_ARRAYS keep their elements byte swapped, marked by NBT_TAG_SWAPPED.
+Elements are swapped one at a time as they are accessed, and writing to the byte order they came from is a plain copy.
+*/
+NBT_INLINE int32_t nbtArrayInt(const int32_t* values, uint32_t i, uint8_t flags) {
+	uint32_t v;
+	memcpy(&v, values + i, 4);
+	return flags & NBT_TAG_SWAPPED ? __builtin_bswap32(v) : v;
+}
+
+NBT_INLINE int64_t nbtArrayLong(const int64_t* values, uint32_t i, uint8_t flags) {
+	uint64_t v;
+	memcpy(&v, values + i, 8);
+	return flags & NBT_TAG_SWAPPED ? __builtin_bswap64(v) : v;
+}
+
+/* convertArrayFormat from an array that may be kept swapped */
+NBT_INLINE void convertArrayFlagged(void* dst, const void* src, size_t count, int width, uint8_t flags, const int format) {
+	if((flags & NBT_TAG_SWAPPED) ? !nbtNative(format) : nbtNative(format))
+		memcpy(dst, src, count * width);
+	else
+		nbtSwap(dst, src, count, width);
+}
+
+int32_t nbtIntAt(tag array, uint32_t i) {
+	return nbtArrayInt(array.payload.asInts, i, array.flags);
+}
+
+int64_t nbtLongAt(tag array, uint32_t i) {
+	return nbtArrayLong(array.payload.asLongs, i, array.flags);
+}
+
+void nbtSetIntAt(tag* array, uint32_t i, int32_t value) {
+	uint32_t v = array->flags & NBT_TAG_SWAPPED ? __builtin_bswap32(value) : (uint32_t)value;
+	memcpy(array->payload.asInts + i, &v, 4);
+}
+
+void nbtSetLongAt(tag* array, uint32_t i, int64_t value) {
+	uint64_t v = array->flags & NBT_TAG_SWAPPED ? __builtin_bswap64(value) : (uint64_t)value;
+	memcpy(array->payload.asLongs + i, &v, 8);
+}
+
+nbt_string nbtName(tag t) {
+	return (nbt_string){t.name, t.name_length};
+}
+
+nbt_string nbtString(tag t) {
+	return (nbt_string){t.payload.asString, t.length};
+}
+
+int nbtNameEquals(tag t, const char* name, size_t length) {
+	return t.name_length == length && (t.name == name || memcmp(t.name, name, length) == 0);
+}
+
+/* Return a tag based on a compound tag or payload and name */
+tag nbtPayloadGet(const tag* const compound, uint32_t compound_length, const char* const name) {
+	// Names may be borrowed and unterminated, so compare by length rather than strcmp
+	size_t name_length = strlen(name);
+	for(uint32_t i = 0; i < compound_length; i++)
+		if(nbtNameEquals(compound[i], name, name_length))
+			return compound[i];
+	return (tag){0};
+}
+
+/*
+Compound name index
+An open addressed hash table of uint32_t slots, stored directly after the compound's children in the same allocation.
+Each slot holds a child's position + 1, 0 being empty. The table is at least twice the size of the compound, so probes stay short.
+*/
+static uint32_t nbtHash(const char* name, size_t length) {
+	uint32_t hash = 2166136261u; // FNV-1a
+	for(size_t i = 0; i < length; i++)
+		hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+	return hash;
+}
+
+static uint32_t nbtIndexSlots(uint32_t compound_length) {
+	uint32_t slots = 16;
+	while(slots < compound_length * 2)
+		slots <<= 1;
+	return slots;
+}
+
+static size_t nbtIndexedSize(uint32_t compound_length) {
+	return compound_length * sizeof(tag) + nbtIndexSlots(compound_length) * sizeof(uint32_t);
+}
+
+/* Fill in the index of a compound whose array already has room for it */
+static void nbtIndexFill(tag* compound, uint32_t compound_length) {
+	uint32_t slots = nbtIndexSlots(compound_length);
+	uint32_t* index = (uint32_t*)(compound + compound_length);
+	memset(index, 0, slots * sizeof(uint32_t));
+	for(uint32_t i = 0; i < compound_length; i++) {
+		uint32_t slot = nbtHash(compound[i].name, compound[i].name_length) & (slots - 1);
+		while(index[slot])
+			slot = (slot + 1) & (slots - 1);
+		index[slot] = i + 1;
+	}
+}
+
+static tag nbtIndexGet(const tag* compound, uint32_t compound_length, const char* name) {
+	size_t name_length = strlen(name);
+	uint32_t slots = nbtIndexSlots(compound_length);
+	const uint32_t* index = (const uint32_t*)(compound + compound_length);
+	for(uint32_t slot = nbtHash(name, name_length) & (slots - 1); index[slot]; slot = (slot + 1) & (slots - 1))
+		if(nbtNameEquals(compound[index[slot] - 1], name, name_length))
+			return compound[index[slot] - 1];
+	return (tag){0};
+}
+
+tag nbtGet(tag compoundTag, const char* const name) {
+	if(compoundTag.flags & NBT_TAG_INDEXED)
+		return nbtIndexGet(compoundTag.payload.asCompound, compoundTag.length, name);
+	return nbtPayloadGet(compoundTag.payload.asCompound, compoundTag.length, name);
+}
+
+tag nbtGetInterned(tag compoundTag, const char* name) {
+	for(uint32_t i = 0; i < compoundTag.length; i++)
+		if(compoundTag.payload.asCompound[i].name == name)
+			return compoundTag.payload.asCompound[i];
+	return (tag){0};
+}
+
+static void* nbtPoolRealloc(void* ptr, size_t size);
+
+int nbtIndex(tag* compoundTag) {
+	if(compoundTag->id != 10)
+		return -1;
+	if(compoundTag->flags & NBT_TAG_INDEXED)
+		return 0;
+	if(compoundTag->flags & NBT_TAG_ARENA)
+		return -1;
+	tag* compound = compoundTag->flags & NBT_TAG_POOLED ? nbtPoolRealloc(compoundTag->payload.asCompound, nbtIndexedSize(compoundTag->length))
+		: realloc(compoundTag->payload.asCompound, nbtIndexedSize(compoundTag->length));
+	if(!compound)
+		return -1;
+	nbtIndexFill(compound, compoundTag->length);
+	compoundTag->payload.asCompound = compound;
+	compoundTag->flags |= NBT_TAG_INDEXED;
+	return 0;
+}
+
+tag nbtLookup(tag* compoundTag, const char* const name) {
+	if(compoundTag->length >= NBT_INDEX_MIN && !(compoundTag->flags & NBT_TAG_INDEXED))
+		nbtIndex(compoundTag);
+	return nbtGet(*compoundTag, name);
+}
+
+#define NBT_ARENA_DEFAULT_BLOCK 65536
+#define NBT_ARENA_ALIGN 8
+
+void nbtArenaInit(nbt_arena* arena, size_t block_size) {
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->block_size = block_size ? block_size : NBT_ARENA_DEFAULT_BLOCK;
+	arena->allocations = 0;
+}
+
+void* nbtArenaAlloc(nbt_arena* arena, size_t size) {
+	size = (size + NBT_ARENA_ALIGN - 1) & ~(size_t)(NBT_ARENA_ALIGN - 1);
+	nbt_arena_block* block = arena->current;
+	// Move on to blocks kept from before the last reset, until one fits
+	while(block && block->size - block->used < size) {
+		block = block->next;
+		if(block)
+			block->used = 0;
+	}
+	if(!block) {
+		size_t block_size = size > arena->block_size ? size : arena->block_size;
+		block = malloc(sizeof(nbt_arena_block) + block_size);
+		if(!block)
+			return NULL;
+		block->size = block_size;
+		block->used = 0;
+		// Slot the new block in after the current one, any blocks past it are still unused since the last reset
+		if(arena->current) {
+			block->next = arena->current->next;
+			arena->current->next = block;
+		} else {
+			block->next = NULL;
+			arena->first = block;
+		}
+	}
+	arena->current = block;
+	void* out = (char*)(block + 1) + block->used;
+	block->used += size;
+	arena->allocations++;
+	return out;
+}
+
+/* Grow the most recent allocation in place when there's room, otherwise move it into a fresh allocation */
+static void* nbtArenaGrow(nbt_arena* arena, void* ptr, size_t old_size, size_t size) {
+	nbt_arena_block* block = arena->current;
+	size_t old_aligned = (old_size + NBT_ARENA_ALIGN - 1) & ~(size_t)(NBT_ARENA_ALIGN - 1);
+	size_t aligned = (size + NBT_ARENA_ALIGN - 1) & ~(size_t)(NBT_ARENA_ALIGN - 1);
+	if(ptr && block && (char*)ptr + old_aligned == (char*)(block + 1) + block->used && block->used - old_aligned + aligned <= block->size) {
+		block->used += aligned - old_aligned;
+		return ptr;
+	}
+	void* out = nbtArenaAlloc(arena, size);
+	// A shrinking move only keeps what fits
+	if(out && ptr)
+		memcpy(out, ptr, old_size < size ? old_size : size);
+	return out;
+}
+
+/* Take over every block of another arena, whose allocations then live as long as this arena's do */
+static void nbtArenaAdopt(nbt_arena* arena, nbt_arena* other) {
+	if(!other->first)
+		return;
+	nbt_arena_block* last = other->first;
+	while(last->next)
+		last = last->next;
+	// Splice the blocks in after the current one, so whatever follows them is still free
+	if(arena->current) {
+		last->next = arena->current->next;
+		arena->current->next = other->first;
+	} else {
+		last->next = arena->first;
+		arena->first = other->first;
+	}
+	arena->current = last;
+	arena->allocations += other->allocations;
+	other->first = NULL;
+	other->current = NULL;
+}
+
+void nbtArenaReset(nbt_arena* arena) {
+	arena->current = arena->first;
+	if(arena->current)
+		arena->current->used = 0;
+	arena->allocations = 0;
+}
+
+void nbtArenaRelease(nbt_arena* arena) {
+	nbt_arena_block* block = arena->first;
+	while(block) {
+		nbt_arena_block* next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->allocations = 0;
+}
+
+/*
+Intern tables
+Names are bumped out of the table's own arena, each behind a 2 byte length. The slots are a hash table of those names kept at most half full.
+*/
+#define NBT_INTERN_MIN_SLOTS 256
+
+static uint16_t nbtInternLength(const char* name) {
+	uint16_t length;
+	memcpy(&length, name - 2, 2);
+	return length;
+}
+
+void nbtInternInit(nbt_intern* table) {
+	nbtArenaInit(&table->strings, 0);
+	table->slots = NULL;
+	table->count = 0;
+	table->capacity = 0;
+	pthread_mutex_init(&table->lock, NULL);
+}
+
+/* Move every name into a table twice the size */
+static int nbtInternGrow(nbt_intern* table) {
+	size_t capacity = table->capacity ? table->capacity * 2 : NBT_INTERN_MIN_SLOTS;
+	char** slots = calloc(capacity, sizeof(char*));
+	if(!slots)
+		return NBT_ERROR_MEMORY;
+	for(size_t i = 0; i < table->capacity; i++)
+		if(table->slots[i]) {
+			size_t slot = nbtHash(table->slots[i], nbtInternLength(table->slots[i])) & (capacity - 1);
+			while(slots[slot])
+				slot = (slot + 1) & (capacity - 1);
+			slots[slot] = table->slots[i];
+		}
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+	return NBT_OK;
+}
+
+const char* nbtIntern(nbt_intern* table, const char* name, size_t length) {
+	if(length > UINT16_MAX)
+		return NULL;
+	uint32_t hash = nbtHash(name, length);
+	char* out = NULL;
+	pthread_mutex_lock(&table->lock);
+	if(table->count * 2 >= table->capacity && nbtInternGrow(table))
+		goto done;
+	size_t slot = hash & (table->capacity - 1);
+	for(; table->slots[slot]; slot = (slot + 1) & (table->capacity - 1))
+		if(nbtInternLength(table->slots[slot]) == length && memcmp(table->slots[slot], name, length) == 0) {
+			out = table->slots[slot];
+			goto done;
+		}
+	char* block = nbtArenaAlloc(&table->strings, length + 3);
+	if(!block)
+		goto done;
+	uint16_t short_length = length;
+	memcpy(block, &short_length, 2);
+	out = block + 2;
+	memcpy(out, name, length);
+	out[length] = 0;
+	table->slots[slot] = out;
+	table->count++;
+done:
+	pthread_mutex_unlock(&table->lock);
+	return out;
+}
+
+void nbtInternRelease(nbt_intern* table) {
+	nbtArenaRelease(&table->strings);
+	free(table->slots);
+	table->slots = NULL;
+	table->count = 0;
+	table->capacity = 0;
+	pthread_mutex_destroy(&table->lock);
+}
+
+/*
+Per-thread pool
+While a thread's pool is on, reads on it allocate blocks with a small header holding their capacity, and nbtFree hands them back to the pool
+of whichever thread frees them. Capacities are powers of two from NBT_POOL_MIN up, anything larger than the biggest class is never kept.
+*/
+#define NBT_POOL_MIN 32
+#define NBT_POOL_CLASSES 16 // Up to 1 MiB
+#define NBT_POOL_HEADER 16 // Keeps blocks as aligned as malloc's
+
+typedef struct nbt_pool_block_t {
+	size_t capacity;
+	struct nbt_pool_block_t* next; // While it waits in a free list
+} nbt_pool_block;
+
+typedef struct nbt_pool_t {
+	nbt_pool_block* free[NBT_POOL_CLASSES];
+	size_t cached; // Bytes waiting in the free lists
+	size_t limit; // 0 while the pool is off
+} nbt_pool;
+
+static _Thread_local nbt_pool nbt_thread_pool;
+
+/* Smallest class that fits size, NBT_POOL_CLASSES if none does */
+static int nbtPoolClass(size_t size) {
+	int c = 0;
+	while(c < NBT_POOL_CLASSES && (size_t)NBT_POOL_MIN << c < size)
+		c++;
+	return c;
+}
+
+static void* nbtPoolAlloc(size_t size) {
+	nbt_pool* pool = &nbt_thread_pool;
+	int c = nbtPoolClass(size);
+	nbt_pool_block* block;
+	if(c < NBT_POOL_CLASSES && pool->free[c]) {
+		block = pool->free[c];
+		pool->free[c] = block->next;
+		pool->cached -= block->capacity;
+	} else {
+		size_t capacity = c < NBT_POOL_CLASSES ? (size_t)NBT_POOL_MIN << c : size;
+		block = malloc(NBT_POOL_HEADER + capacity);
+		if(!block)
+			return NULL;
+		block->capacity = capacity;
+	}
+	return (char*)block + NBT_POOL_HEADER;
+}
+
+static void nbtPoolFree(void* ptr) {
+	if(!ptr)
+		return;
+	nbt_pool* pool = &nbt_thread_pool;
+	nbt_pool_block* block = (nbt_pool_block*)((char*)ptr - NBT_POOL_HEADER);
+	int c = nbtPoolClass(block->capacity);
+	if(c == NBT_POOL_CLASSES || pool->cached + block->capacity > pool->limit) {
+		free(block);
+		return;
+	}
+	block->next = pool->free[c];
+	pool->free[c] = block;
+	pool->cached += block->capacity;
+}
+
+static void* nbtPoolRealloc(void* ptr, size_t size) {
+	if(!ptr)
+		return nbtPoolAlloc(size);
+	nbt_pool_block* block = (nbt_pool_block*)((char*)ptr - NBT_POOL_HEADER);
+	if(size <= block->capacity)
+		return ptr;
+	void* grown = nbtPoolAlloc(size);
+	if(grown) {
+		memcpy(grown, ptr, block->capacity);
+		nbtPoolFree(ptr);
+	}
+	return grown;
+}
+
+void nbtPoolInit(size_t limit) {
+	nbt_thread_pool.limit = limit;
+}
+
+void nbtPoolRelease(void) {
+	nbt_pool* pool = &nbt_thread_pool;
+	for(int c = 0; c < NBT_POOL_CLASSES; c++)
+		while(pool->free[c]) {
+			nbt_pool_block* next = pool->free[c]->next;
+			free(pool->free[c]);
+			pool->free[c] = next;
+		}
+	pool->cached = 0;
+	pool->limit = 0;
+}
+
+/* Every allocation made while reading goes through these, so the parser decides where memory comes from */
+static void* nbtAlloc(nbt_parser* parser, size_t size) {
+	if(parser->arena)
+		return nbtArenaAlloc(parser->arena, size);
+	if(nbt_thread_pool.limit)
+		return nbtPoolAlloc(size);
+	return malloc(size);
+}
+
+static void* nbtRealloc(nbt_parser* parser, void* ptr, size_t old_size, size_t size) {
+	if(parser->arena)
+		return nbtArenaGrow(parser->arena, ptr, old_size, size);
+	if(nbt_thread_pool.limit)
+		return nbtPoolRealloc(ptr, size);
+	return realloc(ptr, size);
+}
+
+/* The flags every tag read by this parser on this thread starts out with, recording where its memory came from */
+static uint8_t nbtTagFlags(nbt_parser* parser) {
+	uint8_t flags = parser->flags & NBT_READ_BORROW ? NBT_TAG_BORROWED : 0;
+	if(parser->arena)
+		return flags | NBT_TAG_ARENA;
+	if(nbt_thread_pool.limit)
+		return flags | NBT_TAG_POOLED;
+	return flags;
+}
+
+const char* nbtReadInto(nbt_parser* parser, tag* destination, const char* bytes);
+const char* nbtReadPayload(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes);
+static int nbtSkipPayloadFormat(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth, int format);
+
+/*
+Parallel list decoding
+A skip pass finds where every element of the list starts, then the calling thread and up to threads - 1 helpers claim batches of elements
+and decode them into the already allocated list. Helpers get an arena of their own when the parser has one, which the parser's arena adopts afterwards.
+*/
+#define NBT_PARALLEL_BATCH 32
+
+typedef struct nbt_list_job_t {
+	int8_t type;
+	uint32_t length;
+	tag* list;
+	const char* bytes;
+	const size_t* offsets;
+	uint32_t next; // First element no thread has claimed yet
+} nbt_list_job;
+
+typedef struct nbt_list_worker_t {
+	nbt_list_job* job;
+	nbt_parser parser;
+	nbt_arena arena;
+	pthread_t thread;
+} nbt_list_worker;
+
+static void nbtReadListElements(nbt_list_job* job, nbt_parser* parser) {
+	uint32_t i;
+	while((i = __atomic_fetch_add(&job->next, NBT_PARALLEL_BATCH, __ATOMIC_RELAXED)) < job->length) {
+		uint32_t end = job->length - i < NBT_PARALLEL_BATCH ? job->length : i + NBT_PARALLEL_BATCH;
+		for(; i < end; i++) {
+			tag* element = job->list + i;
+			element->flags = nbtTagFlags(parser);
+			element->name_length = 0;
+			element->name = NULL;
+			element->id = job->type;
+			nbtReadPayload(parser, job->type, &element->flags, &element->length, &element->payload, job->bytes + job->offsets[i]);
+		}
+	}
+}
+
+static void* nbtListWorker(void* argument) {
+	nbt_list_worker* worker = argument;
+	nbtReadListElements(worker->job, &worker->parser);
+	return NULL;
+}
+
+/* Decode a list's elements on several threads, returns where the list ends, or NULL if it should be read on this thread after all */
+static const char* nbtReadListParallel(nbt_parser* parser, int8_t type, uint32_t length, tag* list, const char* bytes) {
+	size_t* offsets = malloc(((size_t)length + 1) * sizeof(size_t));
+	if(!offsets)
+		return NULL;
+	offsets[0] = 0;
+	for(uint32_t i = 0; i < length; i++)
+		if(nbtSkipPayloadFormat(bytes, SIZE_MAX, type, offsets[i], offsets + i + 1, 1, parser->format)) {
+			free(offsets);
+			return NULL;
+		}
+	if(offsets[length] < parser->parallel_threshold) {
+		free(offsets);
+		return NULL;
+	}
+
+	nbt_list_job job = {type, length, list, bytes, offsets, 0};
+	int helpers = parser->threads - 1;
+	nbt_list_worker* workers = calloc(helpers, sizeof(nbt_list_worker));
+	if(!workers)
+		helpers = 0;
+	nbt_parser self = *parser;
+	self.threads = 1; // Only the outermost large list is split up
+	for(int i = 0; i < helpers; i++) {
+		workers[i].job = &job;
+		workers[i].parser = self;
+		if(parser->arena) {
+			nbtArenaInit(&workers[i].arena, parser->arena->block_size);
+			workers[i].parser.arena = &workers[i].arena;
+		}
+		if(pthread_create(&workers[i].thread, NULL, nbtListWorker, workers + i)) {
+			helpers = i;
+			break;
+		}
+	}
+	nbtReadListElements(&job, &self);
+	for(int i = 0; i < helpers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if(parser->arena)
+			nbtArenaAdopt(parser->arena, &workers[i].arena);
+	}
+	free(workers);
+	const char* end = bytes + offsets[length];
+	free(offsets);
+	return end;
+}
+
+/*
+Readers and writers for each format
+Each *Body is written once against a format parameter and instantiated for every format below.
+Recursion goes through the *As dispatchers, which fold to a direct call of the same instantiation.
+*/
+static const char* nbtReadPayloadBig(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes);
+static const char* nbtReadPayloadLittle(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes);
+static const char* nbtReadPayloadVarint(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes);
+static const char* nbtReadIntoBig(nbt_parser* parser, tag* tag, const char* bytes);
+static const char* nbtReadIntoLittle(nbt_parser* parser, tag* tag, const char* bytes);
+static const char* nbtReadIntoVarint(nbt_parser* parser, tag* tag, const char* bytes);
+static char* nbtWritePayloadBig(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes);
+static char* nbtWritePayloadLittle(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes);
+static char* nbtWritePayloadVarint(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes);
+static char* nbtWriteTagBig(tag t, char* bytes);
+static char* nbtWriteTagLittle(tag t, char* bytes);
+static char* nbtWriteTagVarint(tag t, char* bytes);
+
+NBT_INLINE const char* nbtReadPayloadAs(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return nbtReadPayloadVarint(parser, type, flags, length, payload, bytes);
+	if(format == NBT_FORMAT_LITTLE)
+		return nbtReadPayloadLittle(parser, type, flags, length, payload, bytes);
+	return nbtReadPayloadBig(parser, type, flags, length, payload, bytes);
+}
+
+NBT_INLINE const char* nbtReadIntoAs(nbt_parser* parser, tag* tag, const char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return nbtReadIntoVarint(parser, tag, bytes);
+	if(format == NBT_FORMAT_LITTLE)
+		return nbtReadIntoLittle(parser, tag, bytes);
+	return nbtReadIntoBig(parser, tag, bytes);
+}
+
+NBT_INLINE char* nbtWritePayloadAs(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return nbtWritePayloadVarint(id, flags, payload, length, bytes);
+	if(format == NBT_FORMAT_LITTLE)
+		return nbtWritePayloadLittle(id, flags, payload, length, bytes);
+	return nbtWritePayloadBig(id, flags, payload, length, bytes);
+}
+
+NBT_INLINE char* nbtWriteTagAs(tag t, char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return nbtWriteTagVarint(t, bytes);
+	if(format == NBT_FORMAT_LITTLE)
+		return nbtWriteTagLittle(t, bytes);
+	return nbtWriteTagBig(t, bytes);
+}
+
+/* Keep an array's elements as they are in the buffer, swapped relative to the host, copying them only if the parser doesn't borrow */
+static const char* nbtReadLazyArray(nbt_parser* parser, uint8_t* flags, void** values, size_t size, const char* bytes) {
+	*flags |= NBT_TAG_SWAPPED;
+	if(parser->flags & NBT_READ_BORROW)
+		*values = (void*)bytes;
+	else {
+		*values = nbtAlloc(parser, size);
+		memcpy(*values, bytes, size);
+	}
+	return bytes + size;
+}
+
+NBT_INLINE const char* nbtReadPayloadBody(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes, const int format) {
+	switch(type) {
+		case 1:
+			payload->asByte = bytes[0];
+			*length = 1;
+			break;
+		case 2:
+			payload->asShort = (int16_t)getUInt16(bytes, format);
+			*length = 2;
+			break;
+		case 3:
+			*length = 4;
+			return getInt32(bytes, &payload->asInt, format);
+		case 4:
+			*length = 8;
+			return getInt64(bytes, &payload->asLong, format);
+		case 5:
+			payload->asFloat = getFloat32(bytes, format);
+			*length = 4;
+			break;
+		case 6:
+			payload->asDouble = getFloat64(bytes, format);
+			*length = 8;
+			break;
+		case 7:
+			bytes = getCount(bytes, length, format);
+			if(parser->flags & NBT_READ_BORROW)
+				payload->asBytes = (int8_t*)bytes;
+			else {
+				payload->asBytes = nbtAlloc(parser, *length);
+				memcpy(payload->asBytes, bytes, *length);
+			}
+			return bytes + *length;
+		case 8:
+			bytes = getStringLength(bytes, length, format);
+			if(parser->flags & NBT_READ_BORROW)
+				payload->asString = (char*)bytes;
+			else {
+				payload->asString = nbtAlloc(parser, *length + 1);
+				memcpy(payload->asString, bytes, *length);
+				payload->asString[*length] = 0;
+			}
+			return bytes + *length;
+		case 9:
+			type = bytes[0];
+			bytes = getCount(bytes+1, length, format);
+			payload->asList = nbtAlloc(parser, *length * sizeof(tag));
+			if(parser->threads > 1 && *length >= NBT_PARALLEL_MIN_ELEMENTS && !nbtFixedSize(type)) {
+				const char* end = nbtReadListParallel(parser, type, *length, payload->asList, bytes);
+				if(end)
+					return end;
+			}
+			uint8_t element_flags = nbtTagFlags(parser);
+			for(uint32_t i = 0; i < *length; i++) { // define "sublength" so something can be passed for length
+				payload->asList[i].flags = element_flags;
+				payload->asList[i].name_length = 0;
+				payload->asList[i].name = NULL;
+				payload->asList[i].id = type;
+				bytes = nbtReadPayloadAs(parser, type, &payload->asList[i].flags, &payload->asList[i].length, &payload->asList[i].payload, bytes, format);
+			}
+			return bytes;
+		case 10: {
+			// Children are collected into a doubling array, rather than growing it by one tag per child
+			uint32_t capacity = 0;
+			*length = 0;
+			payload->asCompound = NULL;
+			while(bytes[0] != 0) {
+				if(*length == capacity) {
+					capacity = capacity ? capacity * 2 : 4;
+					payload->asCompound = nbtRealloc(parser, payload->asCompound, *length * sizeof(tag), capacity * sizeof(tag));
+				}
+				bytes = nbtReadIntoAs(parser, payload->asCompound + (*length)++, bytes, format);
+			}
+			if((parser->flags & NBT_READ_INDEX) && *length >= NBT_INDEX_MIN) {
+				tag* compound = nbtRealloc(parser, payload->asCompound, *length * sizeof(tag), nbtIndexedSize(*length));
+				if(compound) {
+					nbtIndexFill(compound, *length);
+					payload->asCompound = compound;
+					*flags |= NBT_TAG_INDEXED;
+				}
+			}
+			return bytes + 1;
+		}
+		case 11:
+			bytes = getCount(bytes, length, format);
+			if(format != NBT_FORMAT_VARINT && (parser->flags & NBT_READ_LAZY_ARRAYS) && !nbtNative(format))
+				return nbtReadLazyArray(parser, flags, (void**)&payload->asInts, *length * 4, bytes);
+			payload->asInts = nbtAlloc(parser, *length * 4);
+			if(format == NBT_FORMAT_VARINT) {
+				for(uint32_t i = 0; i < *length; i++)
+					bytes = getInt32(bytes, payload->asInts + i, format);
+				return bytes;
+			}
+			convertArrayFormat(payload->asInts, bytes, *length, 4, format);
+			return bytes + *length * 4;
+		case 12:
+			bytes = getCount(bytes, length, format);
+			if(format != NBT_FORMAT_VARINT && (parser->flags & NBT_READ_LAZY_ARRAYS) && !nbtNative(format))
+				return nbtReadLazyArray(parser, flags, (void**)&payload->asLongs, *length * 8, bytes);
+			payload->asLongs = nbtAlloc(parser, *length * 8);
+			if(format == NBT_FORMAT_VARINT) {
+				for(uint32_t i = 0; i < *length; i++)
+					bytes = getInt64(bytes, payload->asLongs + i, format);
+				return bytes;
+			}
+			convertArrayFormat(payload->asLongs, bytes, *length, 8, format);
+			return bytes + *length * 8;
+	}
+	return bytes + *length;
+}
+
+NBT_INLINE const char* nbtReadIntoBody(nbt_parser* parser, tag* tag, const char* bytes, const int format) {
+	uint32_t name_length;
+	tag->id = bytes[0];
+	tag->flags = nbtTagFlags(parser);
+	bytes = getStringLength(bytes + 1, &name_length, format);
+	tag->name_length = name_length;
+	if(parser->intern) {
+		tag->name = (char*)nbtIntern(parser->intern, bytes, name_length);
+		tag->flags |= NBT_TAG_INTERNED;
+	} else if(parser->flags & NBT_READ_BORROW) {
+		tag->name = (char*)bytes;
+	} else {
+		tag->name = nbtAlloc(parser, tag->name_length + 1);
+		memcpy(tag->name, bytes, tag->name_length);
+		tag->name[tag->name_length] = 0;
+	}
+	bytes += tag->name_length;
+
+	// Read payload for respective tag types
+	return nbtReadPayloadBody(parser, tag->id, &tag->flags, &tag->length, &tag->payload, bytes, format);
+}
+
+NBT_INLINE char* nbtWritePayloadBody(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes, const int format) {
+	switch (id) {
+		default:
+			memcpy(bytes, payload.asBytes, length);
+			return bytes + length;
+		case 1:
+			bytes[0] = payload.asByte;
+			return bytes + 1;
+		case 2:
+			putUInt16(payload.asShort, bytes, format);
+			return bytes + 2;
+		case 3:
+			return putInt32(payload.asInt, bytes, format);
+		case 4:
+			return putInt64(payload.asLong, bytes, format);
+		case 5:
+			putFloat32(payload.asFloat, bytes, format);
+			return bytes + 4;
+		case 6:
+			putFloat64(payload.asDouble, bytes, format);
+			return bytes + 8;
+		case 7:
+			bytes = putCount(length, bytes, format);
+			memcpy(bytes, payload.asBytes, length);
+			return bytes + length;
+		case 8:
+			bytes = putStringLength(length, bytes, format);
+			memcpy(bytes, payload.asBytes, length);
+			return bytes + length;
+		case 9:
+			bytes[0] = length == 0 ? 0 : payload.asList[0].id;
+			bytes = putCount(length, bytes+1, format);
+			for(int i = 0; i < length; i++)
+				bytes = nbtWritePayloadAs(payload.asList[i].id, payload.asList[i].flags, payload.asList[i].payload, payload.asList[i].length, bytes, format);
+			return bytes;
+		case 10:
+			for(int i = 0; i < length; i++)
+				bytes = nbtWriteTagAs(payload.asCompound[i], bytes, format);
+			bytes[0] = 0;
+			return bytes + 1;
+		case 11:
+			bytes = putCount(length, bytes, format);
+			if(format == NBT_FORMAT_VARINT) {
+				for(int i = 0; i < length; i++)
+					bytes = putInt32(nbtArrayInt(payload.asInts, i, flags), bytes, format);
+				return bytes;
+			}
+			convertArrayFlagged(bytes, payload.asInts, length, 4, flags, format);
+			return bytes + length*4;
+		case 12:
+			bytes = putCount(length, bytes, format);
+			if(format == NBT_FORMAT_VARINT) {
+				for(int i = 0; i < length; i++)
+					bytes = putInt64(nbtArrayLong(payload.asLongs, i, flags), bytes, format);
+				return bytes;
+			}
+			convertArrayFlagged(bytes, payload.asLongs, length, 8, flags, format);
+			return bytes + length*8;
+	}
+
+}
+
+NBT_INLINE char* nbtWriteTagBody(tag t, char* bytes, const int format) {
+	// Write id, name length, and name
+	*bytes = t.id;
+	bytes = putStringLength(t.name_length, bytes + 1, format);
+	memcpy(bytes, t.name, t.name_length);
+	bytes+=t.name_length;
+
+	// Different types of payloads
+	return nbtWritePayloadBody(t.id, t.flags, t.payload, t.length, bytes, format);
+}
+
+static const char* nbtReadPayloadBig(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes) {
+	return nbtReadPayloadBody(parser, type, flags, length, payload, bytes, NBT_FORMAT_BIG);
+}
+
+static const char* nbtReadPayloadLittle(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes) {
+	return nbtReadPayloadBody(parser, type, flags, length, payload, bytes, NBT_FORMAT_LITTLE);
+}
+
+static const char* nbtReadPayloadVarint(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes) {
+	return nbtReadPayloadBody(parser, type, flags, length, payload, bytes, NBT_FORMAT_VARINT);
+}
+
+static const char* nbtReadIntoBig(nbt_parser* parser, tag* tag, const char* bytes) {
+	return nbtReadIntoBody(parser, tag, bytes, NBT_FORMAT_BIG);
+}
+
+static const char* nbtReadIntoLittle(nbt_parser* parser, tag* tag, const char* bytes) {
+	return nbtReadIntoBody(parser, tag, bytes, NBT_FORMAT_LITTLE);
+}
+
+static const char* nbtReadIntoVarint(nbt_parser* parser, tag* tag, const char* bytes) {
+	return nbtReadIntoBody(parser, tag, bytes, NBT_FORMAT_VARINT);
+}
+
+static char* nbtWritePayloadBig(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes) {
+	return nbtWritePayloadBody(id, flags, payload, length, bytes, NBT_FORMAT_BIG);
+}
+
+static char* nbtWritePayloadLittle(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes) {
+	return nbtWritePayloadBody(id, flags, payload, length, bytes, NBT_FORMAT_LITTLE);
+}
+
+static char* nbtWritePayloadVarint(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes) {
+	return nbtWritePayloadBody(id, flags, payload, length, bytes, NBT_FORMAT_VARINT);
+}
+
+static char* nbtWriteTagBig(tag t, char* bytes) {
+	return nbtWriteTagBody(t, bytes, NBT_FORMAT_BIG);
+}
+
+static char* nbtWriteTagLittle(tag t, char* bytes) {
+	return nbtWriteTagBody(t, bytes, NBT_FORMAT_LITTLE);
+}
+
+static char* nbtWriteTagVarint(tag t, char* bytes) {
+	return nbtWriteTagBody(t, bytes, NBT_FORMAT_VARINT);
+}
+
+const char* nbtReadPayload(nbt_parser* parser, int8_t type, uint8_t* flags, uint32_t* length, union payload* payload, const char* bytes) {
+	return nbtReadPayloadAs(parser, type, flags, length, payload, bytes, nbtFormat(parser->format));
+}
+
+const char* nbtReadInto(nbt_parser* parser, tag* tag, const char* bytes) {
+	return nbtReadIntoAs(parser, tag, bytes, nbtFormat(parser->format));
+}
+
+tag nbtReadWith(nbt_parser* parser, const char* bytes) {
+	tag tag = {0};
+	nbtReadInto(parser, &tag, bytes);
+	return tag;
+}
+
+tag nbtRead(const char* bytes) {
+	nbt_parser parser = {0};
+	return nbtReadWith(&parser, bytes);
+}
+
+/* Hand back one allocation of a tag, to the pool if it came from one */
+static void nbtRelease(uint8_t flags, void* ptr) {
+	if(flags & NBT_TAG_POOLED)
+		nbtPoolFree(ptr);
+	else
+		free(ptr);
+}
+
+static void nbtFreePayload(int8_t id, uint8_t flags, union payload* payload, uint32_t length) {
+	switch(id) {
+		case 7: case 8:
+			if(!(flags & NBT_TAG_BORROWED))
+				nbtRelease(flags, payload->asBytes);
+			break;
+		case 11: case 12:
+			// Lazily read arrays are only borrowed when the rest of the tag is
+			if(!(flags & NBT_TAG_BORROWED && flags & NBT_TAG_SWAPPED))
+				nbtRelease(flags, payload->asInts);
+			break;
+		case 9:
+			for(uint32_t i = 0; i < length; i++)
+				nbtFreePayload(payload->asList[i].id, payload->asList[i].flags, &payload->asList[i].payload, payload->asList[i].length);
+			nbtRelease(flags, payload->asList);
+			break;
+		case 10:
+			for(uint32_t i = 0; i < length; i++)
+				nbtFree(payload->asCompound + i);
+			nbtRelease(flags, payload->asCompound);
+			break;
+	}
+}
+
+void nbtClear(tag* tag) {
+	if(!(tag->flags & NBT_TAG_ARENA))
+		nbtFreePayload(tag->id, tag->flags, &tag->payload, tag->length);
+	memset(&tag->payload, 0, sizeof(tag->payload));
+	tag->length = 0;
+	tag->flags &= ~(NBT_TAG_INDEXED | NBT_TAG_SWAPPED);
+}
+
+void nbtFree(tag* tag) {
+	nbtClear(tag);
+	if(!(tag->flags & (NBT_TAG_ARENA | NBT_TAG_BORROWED | NBT_TAG_INTERNED)))
+		nbtRelease(tag->flags, tag->name);
+	*tag = (struct tag_t){0};
+}
+
+char* nbtWritePayload(int8_t id, uint8_t flags, union payload payload, int32_t length, char* bytes) {
+	return nbtWritePayloadAs(id, flags, payload, length, bytes, nbtFormat(NBT_FORMAT_DEFAULT));
+}
+
+char* nbtWriteFormat(tag t, char* bytes, int format) {
+	return nbtWriteTagAs(t, bytes, nbtFormat(format));
+}
+
+char* nbtWrite(tag t, char* bytes) {
+	return nbtWriteFormat(t, bytes, NBT_FORMAT_DEFAULT);
+}
+
+size_t nbtPeekLength(tag t) {
+	// id + short(name_length) + name_length string(name) + payload size
+	size_t out = 1 + 2 + t.name_length;
+	switch (t.id) {
+		default: return out + t.length;
+		case 7: return out + t.length + 4;
+		case 8: return out + t.length + 2;
+		case 9: 
+			for(int i = 0; i < t.length; i++)
+				out += nbtPeekLength(t.payload.asList[i]) - 3 - t.payload.asList[i].name_length;
+			return out + 5;
+		case 11: return out + t.length * 4 + 4;
+		case 12: return out + t.length * 8 + 4;
+		case 10:
+			for(int i = 0; i < t.length; i++)
+				out += nbtPeekLength(t.payload.asCompound[i]);
+			return out+1;
+	}
+}
+
+/* Payload size in the network format, where ints, longs and lengths take as many bytes as their value needs */
+static size_t nbtVarPayloadLength(int8_t id, uint8_t flags, union payload payload, uint32_t length) {
+	size_t out;
+	switch(id) {
+		default: return length;
+		case 3: return nbtVarUIntSize(zigzag32(payload.asInt));
+		case 4: return nbtVarUIntSize(zigzag64(payload.asLong));
+		case 7: return nbtVarUIntSize(zigzag32(length)) + length;
+		case 8: return nbtVarUIntSize(length) + length;
+		case 9:
+			out = 1 + nbtVarUIntSize(zigzag32(length));
+			for(uint32_t i = 0; i < length; i++)
+				out += nbtVarPayloadLength(payload.asList[i].id, payload.asList[i].flags, payload.asList[i].payload, payload.asList[i].length);
+			return out;
+		case 10:
+			out = 1;
+			for(uint32_t i = 0; i < length; i++)
+				out += nbtPeekLengthFormat(payload.asCompound[i], NBT_FORMAT_VARINT);
+			return out;
+		case 11:
+			out = nbtVarUIntSize(zigzag32(length));
+			for(uint32_t i = 0; i < length; i++)
+				out += nbtVarUIntSize(zigzag32(nbtArrayInt(payload.asInts, i, flags)));
+			return out;
+		case 12:
+			out = nbtVarUIntSize(zigzag32(length));
+			for(uint32_t i = 0; i < length; i++)
+				out += nbtVarUIntSize(zigzag64(nbtArrayLong(payload.asLongs, i, flags)));
+			return out;
+	}
+}
+
+size_t nbtPeekLengthFormat(tag t, int format) {
+	if(nbtFormat(format) != NBT_FORMAT_VARINT)
+		return nbtPeekLength(t);
+	return 1 + nbtVarUIntSize(t.name_length) + t.name_length + nbtVarPayloadLength(t.id, t.flags, t.payload, t.length);
+}
+
+/*
+Tape building
+Every payload is bounds checked against the buffer size before it is looked at, so the tape can be built from untrusted input.
+Materializing entries of a successfully built tape is then safe with the unchecked nbtReadPayload.
+*/
+
+static int nbtTapeEntry(nbt_tape* tape, int8_t id, size_t name, uint16_t name_length, size_t offset, int depth);
+
+static int nbtTapePayload(nbt_tape* tape, int8_t type, size_t offset, size_t* end, uint32_t* length, int depth) {
+	const char* bytes = tape->bytes;
+	size_t size = tape->size;
+	switch(type) {
+		case 1: case 2: case 3: case 4: case 5: case 6:
+			*length = nbtFixedSize(type);
+			if(size - offset < *length)
+				return NBT_ERROR_TRUNCATED;
+			*end = offset + *length;
+			return NBT_OK;
+		case 7: case 11: case 12: {
+			if(size - offset < 4)
+				return NBT_ERROR_TRUNCATED;
+			*length = readUInt32(bytes + offset);
+			uint64_t width = type == 7 ? 1 : type == 11 ? 4 : 8;
+			if(size - offset - 4 < *length * width)
+				return NBT_ERROR_TRUNCATED;
+			*end = offset + 4 + *length * width;
+			return NBT_OK;
+		}
+		case 8:
+			if(size - offset < 2)
+				return NBT_ERROR_TRUNCATED;
+			*length = readUInt16(bytes + offset);
+			if(size - offset - 2 < *length)
+				return NBT_ERROR_TRUNCATED;
+			*end = offset + 2 + *length;
+			return NBT_OK;
+		case 9: {
+			if(depth >= NBT_MAX_DEPTH)
+				return NBT_ERROR_DEPTH;
+			if(size - offset < 5)
+				return NBT_ERROR_TRUNCATED;
+			int8_t element = bytes[offset];
+			*length = readUInt32(bytes + offset + 1);
+			offset += 5;
+			if(element < 0 || element > 12 || (element == 0 && *length != 0))
+				return NBT_ERROR_BAD_ID;
+			if(element == 0 || nbtFixedSize(element)) {
+				if(size - offset < (uint64_t)*length * nbtFixedSize(element))
+					return NBT_ERROR_TRUNCATED;
+				*end = offset + (size_t)*length * nbtFixedSize(element);
+				return NBT_OK;
+			}
+			for(uint32_t i = 0; i < *length; i++) {
+				uint32_t index = tape->count;
+				int error = nbtTapeEntry(tape, element, 0, 0, offset, depth + 1);
+				if(error)
+					return error;
+				offset = tape->entries[index].end;
+			}
+			*end = offset;
+			return NBT_OK;
+		}
+		case 10:
+			if(depth >= NBT_MAX_DEPTH)
+				return NBT_ERROR_DEPTH;
+			*length = 0;
+			while(1) {
+				if(offset >= size)
+					return NBT_ERROR_TRUNCATED;
+				int8_t id = bytes[offset];
+				if(id == 0)
+					break;
+				if(size - offset < 3)
+					return NBT_ERROR_TRUNCATED;
+				uint16_t name_length = readUInt16(bytes + offset + 1);
+				if(size - offset - 3 < name_length)
+					return NBT_ERROR_TRUNCATED;
+				uint32_t index = tape->count;
+				int error = nbtTapeEntry(tape, id, offset + 3, name_length, offset + 3 + name_length, depth + 1);
+				if(error)
+					return error;
+				offset = tape->entries[index].end;
+				(*length)++;
+			}
+			*end = offset + 1;
+			return NBT_OK;
+	}
+	return NBT_ERROR_BAD_ID;
+}
+
+static int nbtTapeEntry(nbt_tape* tape, int8_t id, size_t name, uint16_t name_length, size_t offset, int depth) {
+	if(tape->count == tape->capacity) {
+		uint32_t capacity = tape->capacity ? tape->capacity * 2 : 256;
+		nbt_tape_entry* entries = realloc(tape->entries, capacity * sizeof(nbt_tape_entry));
+		if(!entries)
+			return NBT_ERROR_MEMORY;
+		tape->entries = entries;
+		tape->capacity = capacity;
+	}
+	uint32_t index = tape->count++;
+	nbt_tape_entry* entry = tape->entries + index;
+	entry->id = id;
+	entry->name_length = name_length;
+	entry->name = name;
+	entry->payload = offset;
+
+	// The entries may move while the payload's children are added, so only keep the index around
+	size_t end;
+	uint32_t length;
+	int error = nbtTapePayload(tape, id, offset, &end, &length, depth);
+	if(error)
+		return error;
+	entry = tape->entries + index;
+	entry->end = end;
+	entry->length = length;
+	entry->next = tape->count;
+	return NBT_OK;
+}
+
+int nbtTapeBuild(nbt_tape* tape, const char* bytes, size_t size) {
+	tape->bytes = bytes;
+	tape->size = size;
+	tape->count = 0;
+	if(size > UINT32_MAX)
+		return NBT_ERROR_TOO_LARGE;
+	if(size < 3)
+		return NBT_ERROR_TRUNCATED;
+	uint16_t name_length = readUInt16(bytes + 1);
+	if(size - 3 < name_length)
+		return NBT_ERROR_TRUNCATED;
+	if(bytes[0] == 0)
+		return NBT_ERROR_BAD_ID;
+	return nbtTapeEntry(tape, bytes[0], 3, name_length, 3 + name_length, 0);
+}
+
+void nbtTapeRelease(nbt_tape* tape) {
+	free(tape->entries);
+	tape->entries = NULL;
+	tape->count = 0;
+	tape->capacity = 0;
+}
+
+uint32_t nbtTapeChild(const nbt_tape* tape, uint32_t compound, const char* name) {
+	const nbt_tape_entry* entries = tape->entries;
+	if(compound >= tape->count || entries[compound].id != 10)
+		return NBT_TAPE_NONE;
+	size_t name_length = strlen(name);
+	for(uint32_t i = compound + 1; i < entries[compound].next; i = entries[i].next)
+		if(entries[i].name_length == name_length && memcmp(tape->bytes + entries[i].name, name, name_length) == 0)
+			return i;
+	return NBT_TAPE_NONE;
+}
+
+uint32_t nbtTapeElement(const nbt_tape* tape, uint32_t list, uint32_t i) {
+	const nbt_tape_entry* entries = tape->entries;
+	if(list >= tape->count || entries[list].id != 9 || i >= entries[list].length)
+		return NBT_TAPE_NONE;
+	uint32_t element = list + 1;
+	if(element == entries[list].next)
+		return NBT_TAPE_NONE; // Fixed size elements aren't on the tape
+	while(i--)
+		element = entries[element].next;
+	return element;
+}
+
+tag nbtTapeRead(const nbt_tape* tape, nbt_parser* parser, uint32_t entry) {
+	tag t = {0};
+	if(entry >= tape->count)
+		return t;
+	const nbt_tape_entry* e = tape->entries + entry;
+	if(e->name) {
+		nbtReadInto(parser, &t, tape->bytes + e->name - 3);
+		return t;
+	}
+	// List elements have no header to read from, only their payload
+	t.id = e->id;
+	t.flags = nbtTagFlags(parser);
+	nbtReadPayload(parser, t.id, &t.flags, &t.length, &t.payload, tape->bytes + e->payload);
+	return t;
+}
+
+/*
+Compact documents
+Nodes are 16 bytes, with the children of a compound or list laid out next to each other. Names are deduplicated into one string table,
+and lists of numbers are packed into native arrays in the data area, so most documents take little more memory than their serialized size.
+A compound's children are only known once its end tag is reached, so they wait on the scratch stack and are moved into place together.
+Children therefore come before their parents, and the root is the last node.
+*/
+#define NBT_DOC_ALIGN 8
+
+/* Grow one of a document's buffers to hold at least size items of width bytes */
+static int nbtDocGrow(void** buffer, size_t* capacity, size_t size, size_t width) {
+	if(size <= *capacity && *buffer)
+		return NBT_OK;
+	size_t grown = *capacity ? *capacity : 64;
+	while(grown < size)
+		grown *= 2;
+	void* resized = realloc(*buffer, grown * width);
+	if(!resized)
+		return NBT_ERROR_MEMORY;
+	*buffer = resized;
+	*capacity = grown;
+	return NBT_OK;
+}
+
+/* Reserve size bytes of the data area, returning their offset, or UINT32_MAX */
+static uint32_t nbtDocData(nbt_doc* doc, size_t size) {
+	size_t offset = (doc->data_size + NBT_DOC_ALIGN - 1) & ~(size_t)(NBT_DOC_ALIGN - 1);
+	if(offset + size > UINT32_MAX || nbtDocGrow((void**)&doc->data, &doc->data_capacity, offset + size, 1))
+		return UINT32_MAX;
+	doc->data_size = offset + size;
+	return offset;
+}
+
+/* Find a name in the string table, adding it if it's new. Returns its offset, or UINT32_MAX */
+static uint32_t nbtDocIntern(nbt_doc* doc, const char* name, size_t length) {
+	if(doc->names_used * 2 >= doc->names_capacity) {
+		// Rehash into a table twice the size, names are null terminated so their lengths can be found again
+		size_t capacity = doc->names_capacity ? doc->names_capacity * 2 : 64;
+		uint32_t* names = calloc(capacity, sizeof(uint32_t));
+		if(!names)
+			return UINT32_MAX;
+		for(size_t i = 0; i < doc->names_capacity; i++)
+			if(doc->names[i]) {
+				const char* s = doc->strings + doc->names[i] - 1;
+				size_t slot = nbtHash(s, strlen(s)) & (capacity - 1);
+				while(names[slot])
+					slot = (slot + 1) & (capacity - 1);
+				names[slot] = doc->names[i];
+			}
+		free(doc->names);
+		doc->names = names;
+		doc->names_capacity = capacity;
+	}
+	size_t slot = nbtHash(name, length) & (doc->names_capacity - 1);
+	for(; doc->names[slot]; slot = (slot + 1) & (doc->names_capacity - 1)) {
+		const char* s = doc->strings + doc->names[slot] - 1;
+		if(memcmp(s, name, length) == 0 && s[length] == 0)
+			return doc->names[slot] - 1;
+	}
+	size_t offset = doc->strings_size;
+	if(offset + length + 1 >= UINT32_MAX || nbtDocGrow((void**)&doc->strings, &doc->strings_capacity, offset + length + 1, 1))
+		return UINT32_MAX;
+	memcpy(doc->strings + offset, name, length);
+	doc->strings[offset + length] = 0;
+	doc->strings_size += length + 1;
+	doc->names[slot] = offset + 1;
+	doc->names_used++;
+	return offset;
+}
+
+/* Append nodes to the end of the node array, returning the index of the first */
+static uint32_t nbtDocNodes(nbt_doc* doc, const nbt_node* nodes, size_t count) {
+	if(doc->count + count >= UINT32_MAX || nbtDocGrow((void**)&doc->nodes, &doc->capacity, doc->count + count, sizeof(nbt_node)))
+		return UINT32_MAX;
+	uint32_t first = doc->count;
+	if(nodes)
+		memcpy(doc->nodes + first, nodes, count * sizeof(nbt_node));
+	doc->count += count;
+	return first;
+}
+
+static const char* nbtDocPayloadBig(nbt_doc* doc, nbt_node* node, const char* bytes);
+static const char* nbtDocPayloadLittle(nbt_doc* doc, nbt_node* node, const char* bytes);
+static const char* nbtDocPayloadVarint(nbt_doc* doc, nbt_node* node, const char* bytes);
+
+NBT_INLINE const char* nbtDocPayloadAs(nbt_doc* doc, nbt_node* node, const char* bytes, const int format) {
+	if(format == NBT_FORMAT_VARINT)
+		return nbtDocPayloadVarint(doc, node, bytes);
+	if(format == NBT_FORMAT_LITTLE)
+		return nbtDocPayloadLittle(doc, node, bytes);
+	return nbtDocPayloadBig(doc, node, bytes);
+}
+
+/* Fill in a node whose id is set from the payload at bytes, returns where the payload ends, or NULL when out of memory */
+NBT_INLINE const char* nbtDocPayloadBody(nbt_doc* doc, nbt_node* node, const char* bytes, const int format) {
+	uint32_t length;
+	switch(node->id) {
+		case 1:
+			node->value = (uint8_t)bytes[0];
+			return bytes + 1;
+		case 2:
+			node->value = getUInt16(bytes, format);
+			return bytes + 2;
+		case 3: {
+			int32_t v;
+			bytes = getInt32(bytes, &v, format);
+			node->value = v;
+			return bytes;
+		}
+		case 5:
+			node->value = getUInt32(bytes, format);
+			return bytes + 4;
+		case 4: case 6: {
+			uint32_t offset = nbtDocData(doc, 8);
+			if(offset == UINT32_MAX)
+				return NULL;
+			int64_t v;
+			bytes = node->id == 4 ? getInt64(bytes, &v, format) : (v = getUInt64(bytes, format), bytes + 8);
+			memcpy(doc->data + offset, &v, 8);
+			node->value = offset;
+			return bytes;
+		}
+		case 7: case 8: {
+			bytes = node->id == 7 ? getCount(bytes, &length, format) : getStringLength(bytes, &length, format);
+			// Strings keep a null terminator, as in tags
+			uint32_t offset = nbtDocData(doc, (size_t)length + (node->id == 8));
+			if(offset == UINT32_MAX)
+				return NULL;
+			memcpy(doc->data + offset, bytes, length);
+			if(node->id == 8)
+				doc->data[offset + length] = 0;
+			node->length = length;
+			node->value = offset;
+			return bytes + length;
+		}
+		case 11: case 12: {
+			size_t width = node->id == 11 ? 4 : 8;
+			bytes = getCount(bytes, &length, format);
+			uint32_t offset = nbtDocData(doc, length * width);
+			if(offset == UINT32_MAX)
+				return NULL;
+			node->length = length;
+			node->value = offset;
+			if(format == NBT_FORMAT_VARINT) {
+				for(uint32_t i = 0; i < length; i++)
+					bytes = width == 4 ? getInt32(bytes, (int32_t*)(doc->data + offset) + i, format) : getInt64(bytes, (int64_t*)(doc->data + offset) + i, format);
+				return bytes;
+			}
+			convertArrayFormat(doc->data + offset, bytes, length, width, format);
+			return bytes + length * width;
+		}
+		case 9: {
+			int8_t element = bytes[0];
+			bytes = getCount(bytes + 1, &length, format);
+			node->element = element;
+			node->length = length;
+			size_t width = nbtFixedSize(element);
+			if(width) {
+				// Lists of numbers are packed into a native array, like the array types
+				uint32_t offset = nbtDocData(doc, length * width);
+				if(offset == UINT32_MAX)
+					return NULL;
+				node->value = offset;
+				if(format == NBT_FORMAT_VARINT && (element == 3 || element == 4)) {
+					for(uint32_t i = 0; i < length; i++)
+						bytes = element == 3 ? getInt32(bytes, (int32_t*)(doc->data + offset) + i, format) : getInt64(bytes, (int64_t*)(doc->data + offset) + i, format);
+					return bytes;
+				}
+				if(width == 1)
+					memcpy(doc->data + offset, bytes, length);
+				else
+					convertArrayFormat(doc->data + offset, bytes, length, width, format);
+				return bytes + length * width;
+			}
+			// Elements go straight into a reserved run of nodes, their own children land after it
+			uint32_t first = nbtDocNodes(doc, NULL, length);
+			if(first == UINT32_MAX)
+				return NULL;
+			node->value = first;
+			for(uint32_t i = 0; i < length; i++) {
+				nbt_node child = {element};
+				if(!(bytes = nbtDocPayloadAs(doc, &child, bytes, format)))
+					return NULL;
+				doc->nodes[first + i] = child;
+			}
+			return bytes;
+		}
+		case 10: {
+			size_t start = doc->scratch_count;
+			while(bytes[0] != 0) {
+				nbt_node child = {bytes[0]};
+				bytes = getStringLength(bytes + 1, &length, format);
+				child.name_length = length;
+				if((child.name = nbtDocIntern(doc, bytes, length)) == UINT32_MAX)
+					return NULL;
+				if(!(bytes = nbtDocPayloadAs(doc, &child, bytes + length, format)))
+					return NULL;
+				if(nbtDocGrow((void**)&doc->scratch, &doc->scratch_capacity, doc->scratch_count + 1, sizeof(nbt_node)))
+					return NULL;
+				doc->scratch[doc->scratch_count++] = child;
+			}
+			node->length = doc->scratch_count - start;
+			node->value = nbtDocNodes(doc, doc->scratch + start, node->length);
+			doc->scratch_count = start;
+			if(node->value == UINT32_MAX)
+				return NULL;
+			return bytes + 1;
+		}
+	}
+	return bytes;
+}
+
+static const char* nbtDocPayloadBig(nbt_doc* doc, nbt_node* node, const char* bytes) {
+	return nbtDocPayloadBody(doc, node, bytes, NBT_FORMAT_BIG);
+}
+
+static const char* nbtDocPayloadLittle(nbt_doc* doc, nbt_node* node, const char* bytes) {
+	return nbtDocPayloadBody(doc, node, bytes, NBT_FORMAT_LITTLE);
+}
+
+static const char* nbtDocPayloadVarint(nbt_doc* doc, nbt_node* node, const char* bytes) {
+	return nbtDocPayloadBody(doc, node, bytes, NBT_FORMAT_VARINT);
+}
+
+int nbtDocBuild(nbt_doc* doc, const char* bytes) {
+	doc->count = 0;
+	doc->strings_size = 0;
+	doc->data_size = 0;
+	doc->scratch_count = 0;
+	doc->names_used = 0;
+	if(doc->names)
+		memset(doc->names, 0, doc->names_capacity * sizeof(uint32_t));
+
+	int format = nbtFormat(doc->format);
+	uint32_t length;
+	nbt_node root = {bytes[0]};
+	switch(format) {
+		case NBT_FORMAT_VARINT: bytes = getStringLength(bytes + 1, &length, NBT_FORMAT_VARINT); break;
+		case NBT_FORMAT_LITTLE: bytes = getStringLength(bytes + 1, &length, NBT_FORMAT_LITTLE); break;
+		default: bytes = getStringLength(bytes + 1, &length, NBT_FORMAT_BIG); break;
+	}
+	root.name_length = length;
+	if((root.name = nbtDocIntern(doc, bytes, length)) == UINT32_MAX)
+		return NBT_ERROR_MEMORY;
+	if(!nbtDocPayloadAs(doc, &root, bytes + length, format) || nbtDocNodes(doc, &root, 1) == UINT32_MAX)
+		return NBT_ERROR_MEMORY;
+	return NBT_OK;
+}
+
+void nbtDocRelease(nbt_doc* doc) {
+	free(doc->nodes);
+	free(doc->strings);
+	free(doc->data);
+	free(doc->scratch);
+	free(doc->names);
+	*doc = (nbt_doc){.format = doc->format};
+}
+
+size_t nbtDocMemory(const nbt_doc* doc) {
+	return doc->count * sizeof(nbt_node) + doc->strings_size + doc->data_size;
+}
+
+uint32_t nbtDocRoot(const nbt_doc* doc) {
+	return doc->count ? doc->count - 1 : NBT_NODE_NONE;
+}
+
+nbt_string nbtNodeName(const nbt_doc* doc, uint32_t node) {
+	const nbt_node* n = doc->nodes + node;
+	return (nbt_string){doc->strings + n->name, n->name_length};
+}
+
+uint32_t nbtNodeChild(const nbt_doc* doc, uint32_t compound, const char* name) {
+	const nbt_node* n = doc->nodes + compound;
+	if(n->id != 10)
+		return NBT_NODE_NONE;
+	size_t length = strlen(name);
+	for(uint32_t i = n->value; i < n->value + n->length; i++)
+		if(doc->nodes[i].name_length == length && memcmp(doc->strings + doc->nodes[i].name, name, length) == 0)
+			return i;
+	return NBT_NODE_NONE;
+}
+
+uint32_t nbtNodeElement(const nbt_doc* doc, uint32_t node, uint32_t i) {
+	const nbt_node* n = doc->nodes + node;
+	if((n->id != 10 && (n->id != 9 || nbtFixedSize(n->element))) || i >= n->length)
+		return NBT_NODE_NONE;
+	return n->value + i;
+}
+
+int64_t nbtNodeInt(const nbt_doc* doc, uint32_t node) {
+	const nbt_node* n = doc->nodes + node;
+	int64_t v;
+	switch(n->id) {
+		case 1: return (int8_t)n->value;
+		case 2: return (int16_t)n->value;
+		case 3: return (int32_t)n->value;
+		case 4:
+			memcpy(&v, doc->data + n->value, 8);
+			return v;
+	}
+	return 0;
+}
+
+double nbtNodeFloat(const nbt_doc* doc, uint32_t node) {
+	const nbt_node* n = doc->nodes + node;
+	_Float32 f;
+	_Float64 d;
+	switch(n->id) {
+		case 5:
+			memcpy(&f, &n->value, 4);
+			return f;
+		case 6:
+			memcpy(&d, doc->data + n->value, 8);
+			return d;
+	}
+	return 0;
+}
+
+nbt_string nbtNodeString(const nbt_doc* doc, uint32_t node) {
+	const nbt_node* n = doc->nodes + node;
+	if(n->id != 8)
+		return (nbt_string){NULL, 0};
+	return (nbt_string){doc->data + n->value, n->length};
+}
+
+const void* nbtNodeData(const nbt_doc* doc, uint32_t node) {
+	const nbt_node* n = doc->nodes + node;
+	if(n->id == 7 || n->id == 11 || n->id == 12 || (n->id == 9 && nbtFixedSize(n->element)))
+		return doc->data + n->value;
+	return NULL;
+}
+
+/*
+Skip over a payload without reading it, checking every length against the buffer size.
+Returns the offset the payload ends at through end, and NBT_OK or an NBT_ERROR_* code.
+This is the validator behind nbtValidate, so it walks the document with its own stack instead of recursing,
+and jumps over arrays and lists of fixed size payloads in one step.
+*/
+typedef struct nbt_skip_frame_t {
+	int8_t id;
+	int8_t element;
+	uint32_t remaining;
+} nbt_skip_frame;
+
+/* Bounds checked getStringLength and getCount for the validator */
+NBT_INLINE int nbtSkipStringLength(const char* bytes, size_t size, size_t* offset, uint32_t* length, const int format) {
+	if(format == NBT_FORMAT_VARINT) {
+		uint64_t v;
+		int error = nbtSkipVarInt(bytes, size, offset, NBT_VARINT32_MAX, &v);
+		*length = v;
+		return error;
+	}
+	if(size - *offset < 2)
+		return NBT_ERROR_TRUNCATED;
+	*length = getUInt16(bytes + *offset, format);
+	*offset += 2;
+	return NBT_OK;
+}
+
+NBT_INLINE int nbtSkipCount(const char* bytes, size_t size, size_t* offset, uint32_t* length, const int format) {
+	if(format == NBT_FORMAT_VARINT) {
+		uint64_t v;
+		int error = nbtSkipVarInt(bytes, size, offset, NBT_VARINT32_MAX, &v);
+		*length = unzigzag32(v);
+		return error;
+	}
+	if(size - *offset < 4)
+		return NBT_ERROR_TRUNCATED;
+	*length = getUInt32(bytes + *offset, format);
+	*offset += 4;
+	return NBT_OK;
+}
+
+/* Skip the name of a named tag, whose id is at offset */
+NBT_INLINE int nbtSkipName(const char* bytes, size_t size, size_t* offset, const int format) {
+	uint32_t length;
+	(*offset)++;
+	int error = nbtSkipStringLength(bytes, size, offset, &length, format);
+	if(error)
+		return error;
+	if(length > UINT16_MAX)
+		return NBT_ERROR_TOO_LARGE;
+	if(size - *offset < length)
+		return NBT_ERROR_TRUNCATED;
+	*offset += length;
+	return NBT_OK;
+}
+
+NBT_INLINE int nbtSkipPayloadBody(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth, const int format) {
+	nbt_skip_frame stack[NBT_MAX_DEPTH];
+	int top = 0;
+	int error;
+	uint32_t length;
+	uint64_t value;
+	while(1) {
+		switch(type) {
+			case 1: case 2: case 3: case 4: case 5: case 6:
+				if(!nbtFixedSizeFormat(type, format)) {
+					if((error = nbtSkipVarInt(bytes, size, &offset, type == 3 ? NBT_VARINT32_MAX : NBT_VARINT64_MAX, &value)))
+						return error;
+					break;
+				}
+				if(size - offset < nbtFixedSize(type))
+					return NBT_ERROR_TRUNCATED;
+				offset += nbtFixedSize(type);
+				break;
+			case 7: case 11: case 12:
+				if((error = nbtSkipCount(bytes, size, &offset, &length, format)))
+					return error;
+				if(type != 7 && format == NBT_FORMAT_VARINT) {
+					// Every element is a varint of its own, at least a byte each
+					if(size - offset < length)
+						return NBT_ERROR_TRUNCATED;
+					for(uint32_t i = 0; i < length; i++)
+						if((error = nbtSkipVarInt(bytes, size, &offset, type == 11 ? NBT_VARINT32_MAX : NBT_VARINT64_MAX, &value)))
+							return error;
+					break;
+				}
+				if(size - offset < length * (uint64_t)(type == 7 ? 1 : type == 11 ? 4 : 8))
+					return NBT_ERROR_TRUNCATED;
+				offset += length * (uint64_t)(type == 7 ? 1 : type == 11 ? 4 : 8);
+				break;
+			case 8:
+				if((error = nbtSkipStringLength(bytes, size, &offset, &length, format)))
+					return error;
+				if(size - offset < length)
+					return NBT_ERROR_TRUNCATED;
+				offset += length;
+				break;
+			case 9: {
+				if(depth + top >= NBT_MAX_DEPTH)
+					return NBT_ERROR_DEPTH;
+				if(offset >= size)
+					return NBT_ERROR_TRUNCATED;
+				int8_t element = bytes[offset++];
+				if((error = nbtSkipCount(bytes, size, &offset, &length, format)))
+					return error;
+				if(element < 0 || element > 12 || (element == 0 && length != 0))
+					return NBT_ERROR_BAD_ID;
+				if(element == 0 || nbtFixedSizeFormat(element, format)) {
+					if(size - offset < (uint64_t)length * nbtFixedSize(element))
+						return NBT_ERROR_TRUNCATED;
+					offset += (size_t)length * nbtFixedSize(element);
+				} else if(length)
+					stack[top++] = (nbt_skip_frame){9, element, length};
+				break;
+			}
+			case 10:
+				if(depth + top >= NBT_MAX_DEPTH)
+					return NBT_ERROR_DEPTH;
+				stack[top++] = (nbt_skip_frame){10, 0, 0};
+				break;
+			default:
+				return NBT_ERROR_BAD_ID;
+		}
+
+		// Find the next payload, closing every list and compound that ends before it
+		while(1) {
+			if(top == 0) {
+				*end = offset;
+				return NBT_OK;
+			}
+			nbt_skip_frame* frame = stack + top - 1;
+			if(frame->id == 9) {
+				if(frame->remaining == 0) {
+					top--;
+					continue;
+				}
+				frame->remaining--;
+				type = frame->element;
+				break;
+			}
+			if(offset >= size)
+				return NBT_ERROR_TRUNCATED;
+			type = bytes[offset];
+			if(type == 0) {
+				offset++;
+				top--;
+				continue;
+			}
+			if((error = nbtSkipName(bytes, size, &offset, format)))
+				return error;
+			break;
+		}
+	}
+}
+
+static int nbtSkipPayloadBig(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth) {
+	return nbtSkipPayloadBody(bytes, size, type, offset, end, depth, NBT_FORMAT_BIG);
+}
+
+static int nbtSkipPayloadLittle(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth) {
+	return nbtSkipPayloadBody(bytes, size, type, offset, end, depth, NBT_FORMAT_LITTLE);
+}
+
+static int nbtSkipPayloadVarint(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth) {
+	return nbtSkipPayloadBody(bytes, size, type, offset, end, depth, NBT_FORMAT_VARINT);
+}
+
+static int nbtSkipPayloadFormat(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth, int format) {
+	switch(nbtFormat(format)) {
+		case NBT_FORMAT_VARINT: return nbtSkipPayloadVarint(bytes, size, type, offset, end, depth);
+		case NBT_FORMAT_LITTLE: return nbtSkipPayloadLittle(bytes, size, type, offset, end, depth);
+	}
+	return nbtSkipPayloadBig(bytes, size, type, offset, end, depth);
+}
+
+static int nbtSkipPayload(const char* bytes, size_t size, int8_t type, size_t offset, size_t* end, int depth) {
+	return nbtSkipPayloadFormat(bytes, size, type, offset, end, depth, NBT_FORMAT_DEFAULT);
+}
+
+int64_t nbtSkip(const char* bytes, size_t size, int8_t type) {
+	size_t end;
+	int error = nbtSkipPayload(bytes, size, type, 0, &end, 0);
+	return error ? error : (int64_t)end;
+}
+
+int64_t nbtValidateFormat(const char* bytes, size_t size, int format) {
+	if(size < 1)
+		return NBT_ERROR_TRUNCATED;
+	if(bytes[0] == 0)
+		return NBT_ERROR_BAD_ID;
+	size_t end = 0;
+	int error;
+	switch(nbtFormat(format)) {
+		case NBT_FORMAT_VARINT: error = nbtSkipName(bytes, size, &end, NBT_FORMAT_VARINT); break;
+		case NBT_FORMAT_LITTLE: error = nbtSkipName(bytes, size, &end, NBT_FORMAT_LITTLE); break;
+		default: error = nbtSkipName(bytes, size, &end, NBT_FORMAT_BIG); break;
+	}
+	if(error)
+		return error;
+	error = nbtSkipPayloadFormat(bytes, size, bytes[0], end, &end, 0, format);
+	return error ? error : (int64_t)end;
+}
+
+int64_t nbtValidate(const char* bytes, size_t size) {
+	return nbtValidateFormat(bytes, size, NBT_FORMAT_DEFAULT);
+}
+
+int nbtPathCompile(nbt_path* path, const char* expression) {
+	path->count = 0;
+	const char* c = expression;
+	while(*c) {
+		if(path->count == NBT_PATH_MAX_STEPS)
+			return -1;
+		nbt_path_step* step = path->steps + path->count++;
+		if(*c == '[') {
+			c++;
+			if(*c == '*') {
+				step->kind = NBT_PATH_ALL;
+				c++;
+			} else {
+				if(*c < '0' || *c > '9')
+					return -1;
+				step->kind = NBT_PATH_INDEX;
+				step->index = 0;
+				while(*c >= '0' && *c <= '9') {
+					// Indices past UINT32_MAX can't address anything, rather than wrapping around to one that does
+					if(step->index > (UINT32_MAX - (*c - '0')) / 10)
+						return -1;
+					step->index = step->index * 10 + (*c++ - '0');
+				}
+			}
+			if(*c++ != ']')
+				return -1;
+		} else {
+			// Names run until the next separator, a leading '.' separates it from whatever came before and is required there
+			if(path->count > 1 && *c++ != '.')
+				return -1;
+			step->kind = NBT_PATH_NAME;
+			step->name = c;
+			while(*c && *c != '.' && *c != '[')
+				c++;
+			step->name_length = c - step->name;
+			if(step->name_length == 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+typedef struct nbt_query_t {
+	const char* bytes;
+	size_t size;
+	const nbt_path* path;
+	nbt_match* matches;
+	size_t capacity;
+	long found;
+} nbt_query;
+
+static int nbtQueryMatch(nbt_query* query, int8_t type, size_t offset, size_t end) {
+	if((size_t)query->found < query->capacity)
+		query->matches[query->found] = (nbt_match){type, offset, end - offset};
+	query->found++;
+	return NBT_OK;
+}
+
+/* Apply the remaining steps of the path to the payload at offset, returning where that payload ends through end */
+static int nbtQueryPayload(nbt_query* query, int step, int8_t type, size_t offset, size_t* end, int depth) {
+	const char* bytes = query->bytes;
+	size_t size = query->size;
+	if(step == query->path->count) {
+		int error = nbtSkipPayload(bytes, size, type, offset, end, depth);
+		return error ? error : nbtQueryMatch(query, type, offset, *end);
+	}
+	const nbt_path_step* s = query->path->steps + step;
+	if(depth >= NBT_MAX_DEPTH)
+		return NBT_ERROR_DEPTH;
+
+	if(s->kind == NBT_PATH_NAME && type == 10) {
+		int found = 0;
+		while(1) {
+			if(offset >= size)
+				return NBT_ERROR_TRUNCATED;
+			int8_t id = bytes[offset];
+			if(id == 0)
+				break;
+			if(size - offset < 3)
+				return NBT_ERROR_TRUNCATED;
+			uint16_t name_length = readUInt16(bytes + offset + 1);
+			if(size - offset - 3 < name_length)
+				return NBT_ERROR_TRUNCATED;
+			size_t payload = offset + 3 + name_length;
+			int error;
+			// Names are unique within a compound, so only the first match needs to be followed
+			if(!found && name_length == s->name_length && memcmp(bytes + offset + 3, s->name, name_length) == 0) {
+				found = 1;
+				error = nbtQueryPayload(query, step + 1, id, payload, &offset, depth + 1);
+			} else
+				error = nbtSkipPayload(bytes, size, id, payload, &offset, depth + 1);
+			if(error)
+				return error;
+		}
+		*end = offset + 1;
+		return NBT_OK;
+	}
+
+	if(s->kind != NBT_PATH_NAME && type == 9) {
+		if(size - offset < 5)
+			return NBT_ERROR_TRUNCATED;
+		int8_t element = bytes[offset];
+		uint32_t length = readUInt32(bytes + offset + 1);
+		size_t width = nbtFixedSize(element);
+		offset += 5;
+		if(element == 0 && length != 0)
+			return NBT_ERROR_BAD_ID;
+		if(width) {
+			// Fixed size elements can be jumped to directly
+			if(size - offset < (uint64_t)length * width)
+				return NBT_ERROR_TRUNCATED;
+			*end = offset + (size_t)length * width;
+			for(uint32_t i = 0; i < length; i++) {
+				if(s->kind == NBT_PATH_INDEX && i != s->index)
+					continue;
+				size_t element_end;
+				int error = nbtQueryPayload(query, step + 1, element, offset + i * width, &element_end, depth + 1);
+				if(error)
+					return error;
+			}
+			return NBT_OK;
+		}
+		for(uint32_t i = 0; i < length; i++) {
+			int error;
+			if(s->kind == NBT_PATH_ALL || i == s->index)
+				error = nbtQueryPayload(query, step + 1, element, offset, &offset, depth + 1);
+			else
+				error = nbtSkipPayload(bytes, size, element, offset, &offset, depth + 1);
+			if(error)
+				return error;
+		}
+		*end = offset;
+		return NBT_OK;
+	}
+
+	if(s->kind != NBT_PATH_NAME && (type == 7 || type == 11 || type == 12)) {
+		int error = nbtSkipPayload(bytes, size, type, offset, end, depth);
+		if(error)
+			return error;
+		uint32_t length = readUInt32(bytes + offset);
+		int8_t element = type == 7 ? 1 : type == 11 ? 3 : 4;
+		size_t width = nbtFixedSize(element);
+		offset += 4;
+		// Array elements have nothing further to descend into, so only a final step can match them
+		if(step + 1 != query->path->count)
+			return NBT_OK;
+		for(uint32_t i = 0; i < length; i++)
+			if(s->kind == NBT_PATH_ALL || i == s->index)
+				nbtQueryMatch(query, element, offset + i * width, offset + (i + 1) * width);
+		return NBT_OK;
+	}
+
+	// The step doesn't apply to this type of payload, so nothing under it can match
+	return nbtSkipPayload(bytes, size, type, offset, end, depth);
+}
+
+long nbtQuery(const char* bytes, size_t size, const nbt_path* path, nbt_match* matches, size_t capacity) {
+	nbt_query query = {bytes, size, path, matches, capacity, 0};
+	if(size < 3)
+		return NBT_ERROR_TRUNCATED;
+	uint16_t name_length = readUInt16(bytes + 1);
+	if(size - 3 < name_length)
+		return NBT_ERROR_TRUNCATED;
+	size_t end;
+	int error = nbtQueryPayload(&query, 0, bytes[0], 3 + name_length, &end, 0);
+	return error ? error : query.found;
+}
+
+/*
+Push parsing
+The parser is a state machine over the fields of the format. Fields that have to be seen whole (ids, lengths, names, strings and scalars)
+are used straight from the slice when they fit in it, and gathered into scratch when they straddle two slices.
+Arrays are passed on in runs of whole elements instead, so they never have to fit anywhere.
+*/
+#define NBT_PUSH_CHUNK 4096
+
+#define NBT_PUSH_ID 0
+#define NBT_PUSH_NAME_LENGTH 1
+#define NBT_PUSH_NAME 2
+#define NBT_PUSH_PAYLOAD 3
+#define NBT_PUSH_SCALAR 4
+#define NBT_PUSH_STRING_LENGTH 5
+#define NBT_PUSH_STRING 6
+#define NBT_PUSH_ARRAY_LENGTH 7
+#define NBT_PUSH_ARRAY 8
+#define NBT_PUSH_LIST 9
+#define NBT_PUSH_NEXT 10
+#define NBT_PUSH_DONE 11
+
+void nbtPushInit(nbt_push_parser* parser, nbt_event_handler handler, void* user) {
+	parser->handler = handler;
+	parser->user = user;
+	parser->state = NBT_PUSH_ID;
+	parser->have = 0;
+	parser->used = 0;
+	parser->depth = 0;
+	if(!parser->scratch) {
+		parser->scratch = malloc(NBT_PUSH_CHUNK);
+		parser->scratch_size = parser->scratch ? NBT_PUSH_CHUNK : 0;
+	}
+}
+
+void nbtPushRelease(nbt_push_parser* parser) {
+	free(parser->scratch);
+	parser->scratch = NULL;
+	parser->scratch_size = 0;
+}
+
+/* Make the current field available through field. Returns 1 once it is whole, 0 if the slice ran out first */
+static int nbtPushGather(nbt_push_parser* parser, const char** bytes, size_t* size, const char** field) {
+	if(parser->have == 0 && *size >= parser->need) {
+		*field = *bytes;
+		*bytes += parser->need;
+		*size -= parser->need;
+		return 1;
+	}
+	if(parser->scratch_size < parser->need) {
+		char* scratch = realloc(parser->scratch, parser->need);
+		if(!scratch)
+			return NBT_ERROR_MEMORY;
+		parser->scratch = scratch;
+		parser->scratch_size = parser->need;
+	}
+	size_t n = parser->need - parser->have < *size ? parser->need - parser->have : *size;
+	memcpy(parser->scratch + parser->have, *bytes, n);
+	parser->have += n;
+	*bytes += n;
+	*size -= n;
+	if(parser->have < parser->need)
+		return 0;
+	parser->have = 0;
+	*field = parser->scratch;
+	return 1;
+}
+
+/* Report a run of count array elements from data, converted to host order */
+static int nbtPushArray(nbt_push_parser* parser, const char* data, uint32_t count, int width) {
+	nbt_event event = {NBT_EVENT_ARRAY, parser->id, parser->count, parser->index, data, (size_t)count * width};
+	if(width > 1) {
+		if(parser->scratch_size < NBT_PUSH_CHUNK) {
+			char* scratch = realloc(parser->scratch, NBT_PUSH_CHUNK);
+			if(!scratch)
+				return NBT_ERROR_MEMORY;
+			parser->scratch = scratch;
+			parser->scratch_size = NBT_PUSH_CHUNK;
+		}
+		// A single element gathered across slices is already in scratch, so move it out of the way first
+		char element[8];
+		if(data == parser->scratch) {
+			memcpy(element, data, width);
+			data = element;
+		}
+		convertArray(parser->scratch, data, count, width);
+		event.data = parser->scratch;
+	}
+	parser->index += count;
+	return parser->handler(parser->user, &event);
+}
+
+int nbtPushFeed(nbt_push_parser* parser, const char* bytes, size_t size) {
+	const char* start = bytes;
+	const char* field;
+	nbt_push_frame* frame;
+	int result = 0;
+	while(1) {
+		nbt_event event = {0};
+		event.id = parser->id;
+		switch(parser->state) {
+			case NBT_PUSH_DONE:
+				parser->used = bytes - start;
+				return NBT_DONE;
+			case NBT_PUSH_ID:
+				parser->need = 1;
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				parser->id = field[0];
+				if(parser->id == 0 && parser->depth > 0) {
+					// End of the enclosing compound
+					event.type = NBT_EVENT_END;
+					event.id = 10;
+					parser->depth--;
+					parser->state = NBT_PUSH_NEXT;
+					break;
+				}
+				if(parser->id < 1 || parser->id > 12)
+					return NBT_ERROR_BAD_ID;
+				parser->state = NBT_PUSH_NAME_LENGTH;
+				continue;
+			case NBT_PUSH_NAME_LENGTH:
+				parser->need = 2;
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				parser->need = readUInt16(field);
+				parser->state = NBT_PUSH_NAME;
+				continue;
+			case NBT_PUSH_NAME:
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				event.type = NBT_EVENT_KEY;
+				event.data = field;
+				event.length = parser->need;
+				parser->state = NBT_PUSH_PAYLOAD;
+				break;
+			case NBT_PUSH_PAYLOAD:
+				// Work out how to read the payload from its type, compounds and lists open a frame straight away
+				switch(parser->id) {
+					case 7: case 11: case 12:
+						parser->state = NBT_PUSH_ARRAY_LENGTH;
+						continue;
+					case 8:
+						parser->state = NBT_PUSH_STRING_LENGTH;
+						continue;
+					case 9:
+						parser->state = NBT_PUSH_LIST;
+						continue;
+					case 10:
+						if(parser->depth == NBT_MAX_DEPTH)
+							return NBT_ERROR_DEPTH;
+						parser->frames[parser->depth++] = (nbt_push_frame){10, 0, 0};
+						event.type = NBT_EVENT_BEGIN_COMPOUND;
+						parser->state = NBT_PUSH_ID;
+						break;
+					default:
+						parser->state = NBT_PUSH_SCALAR;
+						continue;
+				}
+				break;
+			case NBT_PUSH_SCALAR:
+				parser->need = nbtFixedSize(parser->id);
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				event.type = NBT_EVENT_VALUE;
+				switch(parser->id) {
+					case 1: event.value.asByte = field[0]; break;
+					case 2: event.value.asShort = readInt16(field); break;
+					case 3: event.value.asInt = readInt32(field); break;
+					case 4: event.value.asLong = readInt64(field); break;
+					case 5: event.value.asFloat = readFloat32(field); break;
+					case 6: event.value.asDouble = readFloat64(field); break;
+				}
+				parser->state = NBT_PUSH_NEXT;
+				break;
+			case NBT_PUSH_STRING_LENGTH:
+				parser->need = 2;
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				parser->need = readUInt16(field);
+				parser->state = NBT_PUSH_STRING;
+				continue;
+			case NBT_PUSH_STRING:
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				event.type = NBT_EVENT_VALUE;
+				event.data = field;
+				event.length = parser->need;
+				parser->state = NBT_PUSH_NEXT;
+				break;
+			case NBT_PUSH_ARRAY_LENGTH:
+				parser->need = 4;
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				parser->count = readUInt32(field);
+				parser->index = 0;
+				parser->state = NBT_PUSH_ARRAY;
+				// Empty arrays still get one (empty) run, so they aren't silently dropped
+				if(parser->count == 0) {
+					parser->state = NBT_PUSH_NEXT;
+					if((result = nbtPushArray(parser, bytes, 0, 1)))
+						return result;
+				}
+				continue;
+			case NBT_PUSH_ARRAY: {
+				int width = parser->id == 7 ? 1 : parser->id == 11 ? 4 : 8;
+				if(parser->have) {
+					// Finish off an element that straddled the previous slice
+					parser->need = width;
+					if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+						goto out;
+					result = nbtPushArray(parser, field, 1, width);
+				} else {
+					size_t count = parser->count - parser->index;
+					if(count > size / width)
+						count = size / width;
+					if(count > NBT_PUSH_CHUNK / width)
+						count = NBT_PUSH_CHUNK / width;
+					if(count == 0) {
+						// Less than one element left in the slice, keep it for next time
+						parser->need = width;
+						result = nbtPushGather(parser, &bytes, &size, &field);
+						goto out;
+					}
+					result = nbtPushArray(parser, bytes, count, width);
+					bytes += count * width;
+					size -= count * width;
+				}
+				if(result)
+					return result;
+				if(parser->index == parser->count)
+					parser->state = NBT_PUSH_NEXT;
+				continue;
+			}
+			case NBT_PUSH_LIST:
+				parser->need = 5;
+				if((result = nbtPushGather(parser, &bytes, &size, &field)) <= 0)
+					goto out;
+				if(parser->depth == NBT_MAX_DEPTH)
+					return NBT_ERROR_DEPTH;
+				frame = parser->frames + parser->depth++;
+				frame->id = 9;
+				frame->element = field[0];
+				frame->remaining = readUInt32(field + 1);
+				if((frame->element < 1 || frame->element > 12) && !(frame->element == 0 && frame->remaining == 0))
+					return NBT_ERROR_BAD_ID;
+				event.type = NBT_EVENT_BEGIN_LIST;
+				event.id = frame->element;
+				event.count = frame->remaining;
+				parser->state = NBT_PUSH_NEXT;
+				break;
+			case NBT_PUSH_NEXT:
+				// The last payload is complete, what comes next depends on what encloses it
+				if(parser->depth == 0) {
+					parser->state = NBT_PUSH_DONE;
+					continue;
+				}
+				frame = parser->frames + parser->depth - 1;
+				if(frame->id == 10) {
+					parser->state = NBT_PUSH_ID;
+					continue;
+				}
+				if(frame->remaining == 0) {
+					event.type = NBT_EVENT_END;
+					event.id = 9;
+					parser->depth--;
+					break;
+				}
+				frame->remaining--;
+				parser->id = frame->element;
+				parser->state = NBT_PUSH_PAYLOAD;
+				continue;
+		}
+		if((result = parser->handler(parser->user, &event)))
+			return result;
+	}
+out:
+	parser->used = bytes - start;
+	return result < 0 ? result : NBT_OK;
+}
+
+/*
+Streaming writer
+Output is assembled in the writer's buffer. Memory writers grow the buffer as needed, file and descriptor writers flush it when it fills up,
+and push arrays through it in pieces so the buffer never has to hold more than the largest name or string.
+*/
+#define NBT_WRITER_MEMORY_START 4096
+#define NBT_WRITER_SINK_SIZE 131072
+
+static void nbtWriterSetup(nbt_writer* writer, size_t capacity) {
+	writer->buffer = malloc(capacity);
+	writer->capacity = writer->buffer ? capacity : 0;
+	writer->size = 0;
+	writer->error = writer->buffer ? NBT_OK : NBT_ERROR_MEMORY;
+	writer->done = 0;
+	writer->depth = 0;
+	writer->format = NBT_FORMAT_DEFAULT;
+}
+
+void nbtWriterInit(nbt_writer* writer) {
+	writer->file = NULL;
+	writer->fd = -1;
+	nbtWriterSetup(writer, NBT_WRITER_MEMORY_START);
+}
+
+void nbtWriterInitFile(nbt_writer* writer, FILE* file) {
+	writer->file = file;
+	writer->fd = -1;
+	nbtWriterSetup(writer, NBT_WRITER_SINK_SIZE);
+}
+
+void nbtWriterInitFd(nbt_writer* writer, int fd) {
+	writer->file = NULL;
+	writer->fd = fd;
+	nbtWriterSetup(writer, NBT_WRITER_SINK_SIZE);
+}
+
+void nbtWriterRelease(nbt_writer* writer) {
+	free(writer->buffer);
+	writer->buffer = NULL;
+	writer->size = 0;
+	writer->capacity = 0;
+}
+
+/* Store a fixed size 16, 32 or 64 bit value in the writer's format, each call picks its instantiation once */
+static void nbtWriterStore16(const nbt_writer* writer, uint16_t v, char* out) {
+	if(nbtFormat(writer->format) == NBT_FORMAT_BIG)
+		putUInt16(v, out, NBT_FORMAT_BIG);
+	else
+		putUInt16(v, out, NBT_FORMAT_LITTLE);
+}
+
+static void nbtWriterStore32(const nbt_writer* writer, uint32_t v, char* out) {
+	if(nbtFormat(writer->format) == NBT_FORMAT_BIG)
+		putUInt32(v, out, NBT_FORMAT_BIG);
+	else
+		putUInt32(v, out, NBT_FORMAT_LITTLE);
+}
+
+static void nbtWriterStore64(const nbt_writer* writer, uint64_t v, char* out) {
+	if(nbtFormat(writer->format) == NBT_FORMAT_BIG)
+		putUInt64(v, out, NBT_FORMAT_BIG);
+	else
+		putUInt64(v, out, NBT_FORMAT_LITTLE);
+}
+
+/* Write a field whose size depends on the format, returning where it ends */
+static char* nbtWriterStringLength(const nbt_writer* writer, uint32_t length, char* out) {
+	switch(nbtFormat(writer->format)) {
+		case NBT_FORMAT_VARINT: return putStringLength(length, out, NBT_FORMAT_VARINT);
+		case NBT_FORMAT_LITTLE: return putStringLength(length, out, NBT_FORMAT_LITTLE);
+	}
+	return putStringLength(length, out, NBT_FORMAT_BIG);
+}
+
+static char* nbtWriterCount(const nbt_writer* writer, uint32_t count, char* out) {
+	switch(nbtFormat(writer->format)) {
+		case NBT_FORMAT_VARINT: return putCount(count, out, NBT_FORMAT_VARINT);
+		case NBT_FORMAT_LITTLE: return putCount(count, out, NBT_FORMAT_LITTLE);
+	}
+	return putCount(count, out, NBT_FORMAT_BIG);
+}
+
+static char* nbtWriterInt32(const nbt_writer* writer, int32_t value, char* out) {
+	switch(nbtFormat(writer->format)) {
+		case NBT_FORMAT_VARINT: return putInt32(value, out, NBT_FORMAT_VARINT);
+		case NBT_FORMAT_LITTLE: return putInt32(value, out, NBT_FORMAT_LITTLE);
+	}
+	return putInt32(value, out, NBT_FORMAT_BIG);
+}
+
+static char* nbtWriterInt64(const nbt_writer* writer, int64_t value, char* out) {
+	switch(nbtFormat(writer->format)) {
+		case NBT_FORMAT_VARINT: return putInt64(value, out, NBT_FORMAT_VARINT);
+		case NBT_FORMAT_LITTLE: return putInt64(value, out, NBT_FORMAT_LITTLE);
+	}
+	return putInt64(value, out, NBT_FORMAT_BIG);
+}
+
+static int nbtWriterFail(nbt_writer* writer, int error) {
+	if(!writer->error)
+		writer->error = error;
+	return writer->error;
+}
+
+/* Hand the buffered output to the file or descriptor, memory writers keep everything */
+static int nbtWriterFlush(nbt_writer* writer) {
+	if(writer->file) {
+		if(fwrite(writer->buffer, 1, writer->size, writer->file) != writer->size)
+			return nbtWriterFail(writer, NBT_ERROR_IO);
+	} else if(writer->fd >= 0) {
+		size_t written = 0;
+		while(written < writer->size) {
+			ssize_t n = write(writer->fd, writer->buffer + written, writer->size - written);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				return nbtWriterFail(writer, NBT_ERROR_IO);
+			written += n;
+		}
+	} else
+		return NBT_OK;
+	writer->size = 0;
+	return NBT_OK;
+}
+
+/* Make room for size more bytes, returning where they go, or NULL after an error */
+static char* nbtWriterReserve(nbt_writer* writer, size_t size) {
+	if(writer->capacity - writer->size < size) {
+		if(nbtWriterFlush(writer))
+			return NULL;
+		if(writer->capacity - writer->size < size) {
+			size_t capacity = writer->capacity;
+			while(capacity - writer->size < size)
+				capacity *= 2;
+			char* buffer = realloc(writer->buffer, capacity);
+			if(!buffer) {
+				nbtWriterFail(writer, NBT_ERROR_MEMORY);
+				return NULL;
+			}
+			writer->buffer = buffer;
+			writer->capacity = capacity;
+		}
+	}
+	char* out = writer->buffer + writer->size;
+	writer->size += size;
+	return out;
+}
+
+/* Give back the part of the last reservation past end, for fields that turned out shorter than their largest size */
+static void nbtWriterTrim(nbt_writer* writer, const char* end) {
+	writer->size = end - writer->buffer;
+}
+
+/* Write the id and name of a tag, or just count it off if it's a list element */
+static int nbtWriterHeader(nbt_writer* writer, int8_t id, const char* name) {
+	if(writer->error)
+		return writer->error;
+	if(writer->done)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	if(writer->depth > 0) {
+		nbt_writer_frame* frame = writer->frames + writer->depth - 1;
+		if(frame->id == 9) {
+			if(frame->element != id || frame->remaining == 0)
+				return nbtWriterFail(writer, NBT_ERROR_STATE);
+			frame->remaining--;
+			return NBT_OK;
+		}
+	}
+	size_t name_length = name ? strlen(name) : 0;
+	if(name_length > UINT16_MAX)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	char* out = nbtWriterReserve(writer, 1 + NBT_VARINT32_MAX + name_length);
+	if(!out)
+		return writer->error;
+	out[0] = id;
+	out = nbtWriterStringLength(writer, name_length, out + 1);
+	memcpy(out, name, name_length);
+	nbtWriterTrim(writer, out + name_length);
+	return NBT_OK;
+}
+
+/* Called after every complete payload, writing a root scalar finishes the document */
+static int nbtWriterValue(nbt_writer* writer) {
+	if(writer->depth == 0)
+		writer->done = 1;
+	return writer->error;
+}
+
+static int nbtWriterOpen(nbt_writer* writer, int8_t id, int8_t element, uint32_t count) {
+	if(writer->depth == NBT_MAX_DEPTH)
+		return nbtWriterFail(writer, NBT_ERROR_DEPTH);
+	writer->frames[writer->depth++] = (nbt_writer_frame){id, element, count};
+	return writer->error;
+}
+
+int nbtBeginCompound(nbt_writer* writer, const char* name) {
+	if(nbtWriterHeader(writer, 10, name))
+		return writer->error;
+	return nbtWriterOpen(writer, 10, 0, 0);
+}
+
+int nbtBeginList(nbt_writer* writer, const char* name, int8_t element, uint32_t count) {
+	if(nbtWriterHeader(writer, 9, name))
+		return writer->error;
+	char* out = nbtWriterReserve(writer, 1 + NBT_VARINT32_MAX);
+	if(!out)
+		return writer->error;
+	out[0] = count ? element : 0;
+	nbtWriterTrim(writer, nbtWriterCount(writer, count, out + 1));
+	return nbtWriterOpen(writer, 9, element, count);
+}
+
+int nbtEnd(nbt_writer* writer) {
+	if(writer->error)
+		return writer->error;
+	if(writer->depth == 0)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	nbt_writer_frame* frame = writer->frames + writer->depth - 1;
+	if(frame->id == 9 && frame->remaining)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	if(frame->id == 10) {
+		char* out = nbtWriterReserve(writer, 1);
+		if(!out)
+			return writer->error;
+		out[0] = 0;
+	}
+	writer->depth--;
+	return nbtWriterValue(writer);
+}
+
+int nbtPutByte(nbt_writer* writer, const char* name, int8_t value) {
+	char* out;
+	if(nbtWriterHeader(writer, 1, name) || !(out = nbtWriterReserve(writer, 1)))
+		return writer->error;
+	out[0] = value;
+	return nbtWriterValue(writer);
+}
+
+int nbtPutShort(nbt_writer* writer, const char* name, int16_t value) {
+	char* out;
+	if(nbtWriterHeader(writer, 2, name) || !(out = nbtWriterReserve(writer, 2)))
+		return writer->error;
+	nbtWriterStore16(writer, value, out);
+	return nbtWriterValue(writer);
+}
+
+int nbtPutInt(nbt_writer* writer, const char* name, int32_t value) {
+	char* out;
+	if(nbtWriterHeader(writer, 3, name) || !(out = nbtWriterReserve(writer, NBT_VARINT32_MAX)))
+		return writer->error;
+	nbtWriterTrim(writer, nbtWriterInt32(writer, value, out));
+	return nbtWriterValue(writer);
+}
+
+int nbtPutLong(nbt_writer* writer, const char* name, int64_t value) {
+	char* out;
+	if(nbtWriterHeader(writer, 4, name) || !(out = nbtWriterReserve(writer, NBT_VARINT64_MAX)))
+		return writer->error;
+	nbtWriterTrim(writer, nbtWriterInt64(writer, value, out));
+	return nbtWriterValue(writer);
+}
+
+int nbtPutFloat(nbt_writer* writer, const char* name, _Float32 value) {
+	char* out;
+	if(nbtWriterHeader(writer, 5, name) || !(out = nbtWriterReserve(writer, 4)))
+		return writer->error;
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	nbtWriterStore32(writer, bits, out);
+	return nbtWriterValue(writer);
+}
+
+int nbtPutDouble(nbt_writer* writer, const char* name, _Float64 value) {
+	char* out;
+	if(nbtWriterHeader(writer, 6, name) || !(out = nbtWriterReserve(writer, 8)))
+		return writer->error;
+	uint64_t bits;
+	memcpy(&bits, &value, 8);
+	nbtWriterStore64(writer, bits, out);
+	return nbtWriterValue(writer);
+}
+
+int nbtPutString(nbt_writer* writer, const char* name, const char* value, size_t length) {
+	char* out;
+	if(length > UINT16_MAX)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	if(nbtWriterHeader(writer, 8, name) || !(out = nbtWriterReserve(writer, NBT_VARINT32_MAX + length)))
+		return writer->error;
+	out = nbtWriterStringLength(writer, length, out);
+	memcpy(out, value, length);
+	nbtWriterTrim(writer, out + length);
+	return nbtWriterValue(writer);
+}
+
+/* Arrays are converted straight into the buffer, a piece at a time when it can't hold all of them */
+static int nbtWriterArray(nbt_writer* writer, int8_t id, const char* name, const void* values, uint32_t count, int width) {
+	char* out;
+	if(nbtWriterHeader(writer, id, name) || !(out = nbtWriterReserve(writer, NBT_VARINT32_MAX)))
+		return writer->error;
+	nbtWriterTrim(writer, nbtWriterCount(writer, count, out));
+	const char* in = values;
+	size_t remaining = count;
+	if(width > 1 && nbtFormat(writer->format) == NBT_FORMAT_VARINT) {
+		// Every element is a varint of its own
+		for(; remaining; remaining--, in += width) {
+			if(!(out = nbtWriterReserve(writer, NBT_VARINT64_MAX)))
+				return writer->error;
+			if(width == 4)
+				nbtWriterTrim(writer, putInt32(*(const int32_t*)in, out, NBT_FORMAT_VARINT));
+			else
+				nbtWriterTrim(writer, putInt64(*(const int64_t*)in, out, NBT_FORMAT_VARINT));
+		}
+		return nbtWriterValue(writer);
+	}
+	while(remaining) {
+		size_t room = (writer->capacity - writer->size) / width;
+		if(room == 0) {
+			if(!nbtWriterReserve(writer, width))
+				return writer->error;
+			writer->size -= width;
+			continue;
+		}
+		size_t n = remaining < room ? remaining : room;
+		if(width == 1)
+			memcpy(writer->buffer + writer->size, in, n);
+		else if(nbtFormat(writer->format) == NBT_FORMAT_BIG)
+			convertArrayFormat(writer->buffer + writer->size, in, n, width, NBT_FORMAT_BIG);
+		else
+			convertArrayFormat(writer->buffer + writer->size, in, n, width, NBT_FORMAT_LITTLE);
+		writer->size += n * width;
+		in += n * width;
+		remaining -= n;
+	}
+	return nbtWriterValue(writer);
+}
+
+int nbtPutByteArray(nbt_writer* writer, const char* name, const int8_t* values, uint32_t count) {
+	return nbtWriterArray(writer, 7, name, values, count, 1);
+}
+
+int nbtPutIntArray(nbt_writer* writer, const char* name, const int32_t* values, uint32_t count) {
+	return nbtWriterArray(writer, 11, name, values, count, 4);
+}
+
+int nbtPutLongArray(nbt_writer* writer, const char* name, const int64_t* values, uint32_t count) {
+	return nbtWriterArray(writer, 12, name, values, count, 8);
+}
+
+int nbtWriterFinish(nbt_writer* writer) {
+	if(writer->error)
+		return writer->error;
+	if(!writer->done)
+		return nbtWriterFail(writer, NBT_ERROR_STATE);
+	if(nbtWriterFlush(writer))
+		return writer->error;
+	if(writer->file && fflush(writer->file))
+		return nbtWriterFail(writer, NBT_ERROR_IO);
+	return NBT_OK;
+}
+
+/*
+File mapping
+The parser never writes to its input, so files can be parsed straight out of a read-only mapping instead of being copied into a buffer first.
+*/
+int nbtMapFile(nbt_map* map, const char* path) {
+	map->bytes = NULL;
+	map->size = 0;
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NBT_ERROR_IO;
+	struct stat info;
+	if(fstat(fd, &info) || info.st_size == 0) {
+		close(fd);
+		return NBT_ERROR_IO;
+	}
+	void* bytes = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps the file alive
+	if(bytes == MAP_FAILED)
+		return NBT_ERROR_IO;
+	madvise(bytes, info.st_size, MADV_SEQUENTIAL);
+	madvise(bytes, info.st_size, MADV_WILLNEED);
+	map->bytes = bytes;
+	map->size = info.st_size;
+	return NBT_OK;
+}
+
+void nbtUnmapFile(nbt_map* map) {
+	if(map->bytes)
+		munmap((void*)map->bytes, map->size);
+	map->bytes = NULL;
+	map->size = 0;
+}
+
+int nbtReadFile(nbt_parser* parser, const char* path, nbt_map* map, tag* out) {
+	*out = (tag){0};
+	int error = nbtMapFile(map, path);
+	if(error)
+		return error;
+	// nbtReadInto trusts every length, and reading past the end of a mapping faults, so check the file before reading it
+	int64_t end = nbtValidateFormat(map->bytes, map->size, parser->format);
+	if(end < 0) {
+		nbtUnmapFile(map);
+		return end;
+	}
+	nbtReadInto(parser, out, map->bytes);
+	return NBT_OK;
+}
+
+/*
+Region files
+The header is mapped shared, and chunks are read with pread at their own offsets, so reads share no file position or other state
+and threads can read chunks of the same region at once, each with its own nbt_chunk.
+*/
+static uint32_t nbtRegionIndex(int x, int z) {
+	return (uint32_t)(x & (NBT_REGION_SIDE - 1)) + (uint32_t)(z & (NBT_REGION_SIDE - 1)) * NBT_REGION_SIDE;
+}
+
+/* Map the header of a region file open as fd, creating an empty header first for empty files when writable */
+static int nbtRegionMap(nbt_region* region, int fd, int writable) {
+	region->fd = -1;
+	region->header = NULL;
+	region->used = NULL;
+	region->sectors = 0;
+	region->used_capacity = 0;
+	if(fd < 0)
+		return NBT_ERROR_IO;
+	struct stat info;
+	if(fstat(fd, &info)) {
+		close(fd);
+		return NBT_ERROR_IO;
+	}
+	if(writable && info.st_size == 0) {
+		static const char empty[NBT_REGION_HEADER];
+		if(pwrite(fd, empty, NBT_REGION_HEADER, 0) != NBT_REGION_HEADER) {
+			close(fd);
+			return NBT_ERROR_IO;
+		}
+		info.st_size = NBT_REGION_HEADER;
+	}
+	if(info.st_size < NBT_REGION_HEADER) {
+		close(fd);
+		return NBT_ERROR_TRUNCATED;
+	}
+	// Shared, so header updates made through pwrite show up in the mapping
+	void* header = mmap(NULL, NBT_REGION_HEADER, PROT_READ, MAP_SHARED, fd, 0);
+	if(header == MAP_FAILED) {
+		close(fd);
+		return NBT_ERROR_IO;
+	}
+	region->fd = fd;
+	region->header = header;
+	region->sectors = (info.st_size + NBT_REGION_SECTOR - 1) / NBT_REGION_SECTOR;
+	pthread_mutex_init(&region->lock, NULL);
+	return NBT_OK;
+}
+
+int nbtRegionOpen(nbt_region* region, const char* path) {
+	return nbtRegionMap(region, open(path, O_RDONLY), 0);
+}
+
+void nbtRegionClose(nbt_region* region) {
+	if(region->header) {
+		munmap((void*)region->header, NBT_REGION_HEADER);
+		pthread_mutex_destroy(&region->lock);
+	}
+	if(region->fd >= 0)
+		close(region->fd);
+	free(region->used);
+	region->fd = -1;
+	region->header = NULL;
+	region->used = NULL;
+}
+
+int nbtRegionHasChunk(const nbt_region* region, int x, int z) {
+	return getUInt32((const char*)region->header + nbtRegionIndex(x, z) * 4, NBT_FORMAT_BIG) != 0;
+}
+
+uint32_t nbtRegionTimestamp(const nbt_region* region, int x, int z) {
+	return getUInt32((const char*)region->header + NBT_REGION_SECTOR + nbtRegionIndex(x, z) * 4, NBT_FORMAT_BIG);
+}
+
+/* Read exactly size bytes at offset, returns NBT_OK or NBT_ERROR_IO, or NBT_ERROR_TRUNCATED when the file ends first */
+static int nbtReadAt(int fd, char* bytes, size_t size, off_t offset) {
+	while(size) {
+		ssize_t got = pread(fd, bytes, size, offset);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got < 0)
+			return NBT_ERROR_IO;
+		if(got == 0)
+			return NBT_ERROR_TRUNCATED;
+		bytes += got;
+		size -= got;
+		offset += got;
+	}
+	return NBT_OK;
+}
+
+/* Make sure a chunk buffer holds at least size bytes, keeping what it already holds */
+/* Deflate's best ratio, about 1032 to 1, a chunk inflating to more than that is hostile */
+#define NBT_INFLATE_RATIO 1032
+
+static int nbtChunkReserve(char** bytes, size_t* capacity, size_t size) {
+	if(size <= *capacity)
+		return NBT_OK;
+	size_t grown = *capacity ? *capacity : NBT_REGION_SECTOR;
+	while(grown < size)
+		grown *= 2;
+	char* resized = realloc(*bytes, grown);
+	if(!resized)
+		return NBT_ERROR_MEMORY;
+	*bytes = resized;
+	*capacity = grown;
+	return NBT_OK;
+}
+
+/* Inflate a gzip or zlib stream into chunk->bytes, growing it as needed */
+static int nbtChunkInflate(nbt_chunk* chunk, const char* compressed, size_t size) {
+	z_stream* stream = chunk->stream;
+	if(!stream) {
+		if(!(stream = calloc(1, sizeof(z_stream))))
+			return NBT_ERROR_MEMORY;
+		// 32 + MAX_WBITS detects gzip or zlib from the stream's own header
+		if(inflateInit2(stream, 32 | MAX_WBITS) != Z_OK) {
+			free(stream);
+			return NBT_ERROR_MEMORY;
+		}
+		chunk->stream = stream;
+	} else if(inflateReset(stream) != Z_OK)
+		return NBT_ERROR_COMPRESSION;
+	// Chunks usually inflate to several times their compressed size, but never past deflate's best ratio
+	size_t limit = size * NBT_INFLATE_RATIO + NBT_REGION_SECTOR;
+	if(nbtChunkReserve(&chunk->bytes, &chunk->capacity, size * 4))
+		return NBT_ERROR_MEMORY;
+	stream->next_in = (Bytef*)compressed;
+	stream->avail_in = size;
+	chunk->size = 0;
+	for(;;) {
+		size_t room = (chunk->capacity < limit ? chunk->capacity : limit) - chunk->size;
+		stream->next_out = (Bytef*)chunk->bytes + chunk->size;
+		stream->avail_out = room;
+		int ret = inflate(stream, Z_NO_FLUSH);
+		chunk->size += room - stream->avail_out;
+		if(ret == Z_STREAM_END)
+			return NBT_OK;
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+			return ret == Z_MEM_ERROR ? NBT_ERROR_MEMORY : NBT_ERROR_COMPRESSION;
+		if(stream->avail_out)
+			return NBT_ERROR_COMPRESSION; // Out of input before the end of the stream
+		if(chunk->size >= limit)
+			return NBT_ERROR_TOO_LARGE; // More than any honest chunk inflates to
+		if(nbtChunkReserve(&chunk->bytes, &chunk->capacity, chunk->capacity * 2 < limit ? chunk->capacity * 2 : limit))
+			return NBT_ERROR_MEMORY;
+	}
+}
+
+int nbtRegionLoad(const nbt_region* region, int x, int z, nbt_chunk* chunk) {
+	chunk->size = 0;
+	uint32_t location = getUInt32((const char*)region->header + nbtRegionIndex(x, z) * 4, NBT_FORMAT_BIG);
+	if(!location)
+		return NBT_ERROR_ABSENT;
+	off_t offset = (off_t)(location >> 8) * NBT_REGION_SECTOR;
+	size_t sectors = location & 0xff;
+
+	// The length and type come first, the rest of the chunk is then read in one go
+	char head[5];
+	int error = nbtReadAt(region->fd, head, 5, offset);
+	if(error)
+		return error;
+	uint32_t length = getUInt32(head, NBT_FORMAT_BIG);
+	uint8_t type = head[4];
+	if(length == 0 || (size_t)length + 4 > sectors * NBT_REGION_SECTOR)
+		return NBT_ERROR_TRUNCATED;
+	size_t size = length - 1;
+
+	if(type == NBT_COMPRESSION_NONE) {
+		if(nbtChunkReserve(&chunk->bytes, &chunk->capacity, size))
+			return NBT_ERROR_MEMORY;
+		if((error = nbtReadAt(region->fd, chunk->bytes, size, offset + 5)))
+			return error;
+		chunk->size = size;
+		return NBT_OK;
+	}
+	if(type != NBT_COMPRESSION_GZIP && type != NBT_COMPRESSION_ZLIB)
+		return NBT_ERROR_COMPRESSION;
+	if(nbtChunkReserve(&chunk->compressed, &chunk->compressed_capacity, size))
+		return NBT_ERROR_MEMORY;
+	if((error = nbtReadAt(region->fd, chunk->compressed, size, offset + 5)))
+		return error;
+	return nbtChunkInflate(chunk, chunk->compressed, size);
+}
+
+int nbtRegionRead(const nbt_region* region, nbt_parser* parser, int x, int z, nbt_chunk* chunk, tag* out) {
+	*out = (tag){0};
+	int error = nbtRegionLoad(region, x, z, chunk);
+	if(error)
+		return error;
+	int64_t end = nbtValidateFormat(chunk->bytes, chunk->size, parser->format);
+	if(end < 0)
+		return end;
+	nbtReadInto(parser, out, chunk->bytes);
+	return NBT_OK;
+}
+
+void nbtChunkRelease(nbt_chunk* chunk) {
+	if(chunk->stream) {
+		inflateEnd(chunk->stream);
+		free(chunk->stream);
+	}
+	if(chunk->deflater) {
+		deflateEnd(chunk->deflater);
+		free(chunk->deflater);
+	}
+	free(chunk->bytes);
+	free(chunk->compressed);
+	*chunk = (nbt_chunk){0};
+}
+
+/*
+Region writes
+A bitmap of the sectors in use is built from the location table when the region is opened for writing, with the two header sectors always in use.
+A chunk goes back where it was when it still fits, giving up any sectors it no longer needs, otherwise into the first run of free sectors
+long enough to hold it, or onto the end of the file. Its sectors are written before its location, so a chunk that moves is never left
+pointing at a half written copy.
+*/
+static int nbtRegionUsed(const nbt_region* region, uint32_t sector) {
+	return sector >= region->used_capacity || (region->used[sector / 64] >> (sector % 64) & 1);
+}
+
+/* Mark count sectors from first as used or free, growing the bitmap to cover them */
+static int nbtRegionMark(nbt_region* region, uint32_t first, uint32_t count, int used) {
+	if(first + count > region->used_capacity) {
+		uint32_t capacity = region->used_capacity ? region->used_capacity : 1024;
+		while(capacity < first + count)
+			capacity *= 2;
+		uint64_t* bitmap = realloc(region->used, capacity / 8);
+		if(!bitmap)
+			return NBT_ERROR_MEMORY;
+		memset(bitmap + region->used_capacity / 64, 0, (capacity - region->used_capacity) / 8);
+		region->used = bitmap;
+		region->used_capacity = capacity;
+	}
+	for(uint32_t i = first; i < first + count; i++)
+		if(used)
+			region->used[i / 64] |= (uint64_t)1 << (i % 64);
+		else
+			region->used[i / 64] &= ~((uint64_t)1 << (i % 64));
+	return NBT_OK;
+}
+
+/* The first sector of a free run of count sectors, which may run off the end of the file */
+static uint32_t nbtRegionFind(const nbt_region* region, uint32_t count) {
+	uint32_t run = 0;
+	for(uint32_t i = NBT_REGION_HEADER / NBT_REGION_SECTOR; i < region->sectors; i++) {
+		run = nbtRegionUsed(region, i) ? 0 : run + 1;
+		if(run == count)
+			return i + 1 - count;
+	}
+	return region->sectors - run;
+}
+
+int nbtRegionOpenWrite(nbt_region* region, const char* path) {
+	int error = nbtRegionMap(region, open(path, O_RDWR | O_CREAT, 0644), 1);
+	if(error)
+		return error;
+	if(nbtRegionMark(region, 0, NBT_REGION_HEADER / NBT_REGION_SECTOR, 1)) {
+		nbtRegionClose(region);
+		return NBT_ERROR_MEMORY;
+	}
+	for(uint32_t i = 0; i < NBT_REGION_SIDE * NBT_REGION_SIDE; i++) {
+		uint32_t location = getUInt32((const char*)region->header + i * 4, NBT_FORMAT_BIG);
+		if(!location)
+			continue;
+		if(nbtRegionMark(region, location >> 8, location & 0xff, 1)) {
+			nbtRegionClose(region);
+			return NBT_ERROR_MEMORY;
+		}
+		if((location >> 8) + (location & 0xff) > region->sectors)
+			region->sectors = (location >> 8) + (location & 0xff);
+	}
+	return NBT_OK;
+}
+
+/* Write one big endian entry of the header */
+static int nbtRegionPutEntry(nbt_region* region, size_t offset, uint32_t value) {
+	char entry[4];
+	putUInt32(value, entry, NBT_FORMAT_BIG);
+	return pwrite(region->fd, entry, 4, offset) == 4 ? NBT_OK : NBT_ERROR_IO;
+}
+
+/* Deflate size bytes into chunk->compressed after room for the chunk's 5 byte head, returns the compressed size through out */
+static int nbtChunkDeflate(nbt_chunk* chunk, const char* bytes, size_t size, int compression, size_t* out) {
+	z_stream* stream = chunk->deflater;
+	if(stream && chunk->deflater_type != compression) {
+		deflateEnd(stream);
+		free(stream);
+		chunk->deflater = stream = NULL;
+	}
+	if(!stream) {
+		if(!(stream = calloc(1, sizeof(z_stream))))
+			return NBT_ERROR_MEMORY;
+		// 16 + MAX_WBITS asks for a gzip wrapper instead of zlib's
+		if(deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, compression == NBT_COMPRESSION_GZIP ? 16 | MAX_WBITS : MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(stream);
+			return NBT_ERROR_MEMORY;
+		}
+		chunk->deflater = stream;
+		chunk->deflater_type = compression;
+	} else if(deflateReset(stream) != Z_OK)
+		return NBT_ERROR_COMPRESSION;
+	size_t bound = 5 + deflateBound(stream, size);
+	if(nbtChunkReserve(&chunk->compressed, &chunk->compressed_capacity, bound + NBT_REGION_SECTOR))
+		return NBT_ERROR_MEMORY;
+	stream->next_in = (Bytef*)bytes;
+	stream->avail_in = size;
+	stream->next_out = (Bytef*)chunk->compressed + 5;
+	stream->avail_out = bound - 5;
+	if(deflate(stream, Z_FINISH) != Z_STREAM_END)
+		return NBT_ERROR_COMPRESSION;
+	*out = stream->total_out;
+	return NBT_OK;
+}
+
+int nbtRegionWrite(nbt_region* region, int x, int z, const char* bytes, size_t size, int compression, nbt_chunk* chunk) {
+	if(!region->used)
+		return NBT_ERROR_STATE;
+	size_t length;
+	if(compression == NBT_COMPRESSION_NONE) {
+		if(nbtChunkReserve(&chunk->compressed, &chunk->compressed_capacity, 5 + size + NBT_REGION_SECTOR))
+			return NBT_ERROR_MEMORY;
+		memmove(chunk->compressed + 5, bytes, size);
+		length = size;
+	} else if(compression == NBT_COMPRESSION_GZIP || compression == NBT_COMPRESSION_ZLIB) {
+		int error = nbtChunkDeflate(chunk, bytes, size, compression, &length);
+		if(error)
+			return error;
+	} else
+		return NBT_ERROR_COMPRESSION;
+
+	// The length counts the type byte, and the chunk is padded out to whole sectors with zeros
+	putUInt32(length + 1, chunk->compressed, NBT_FORMAT_BIG);
+	chunk->compressed[4] = compression;
+	size_t padded = (length + 5 + NBT_REGION_SECTOR - 1) / NBT_REGION_SECTOR * NBT_REGION_SECTOR;
+	memset(chunk->compressed + length + 5, 0, padded - length - 5);
+	uint32_t count = padded / NBT_REGION_SECTOR;
+	if(count > 0xff)
+		return NBT_ERROR_TOO_LARGE;
+
+	uint32_t index = nbtRegionIndex(x, z);
+	pthread_mutex_lock(&region->lock);
+	uint32_t location = getUInt32((const char*)region->header + index * 4, NBT_FORMAT_BIG);
+	uint32_t old_first = location >> 8, old_count = location & 0xff;
+	// Reuse the chunk's own sectors when it fits, otherwise leave them alone until the new copy is in place
+	uint32_t first = location && old_count >= count ? old_first : nbtRegionFind(region, count);
+	int error = first + count > 0xffffff ? NBT_ERROR_TOO_LARGE : nbtRegionMark(region, first, count, 1);
+	const char* out = chunk->compressed;
+	off_t offset = (off_t)first * NBT_REGION_SECTOR;
+	while(padded && !error) {
+		ssize_t wrote = pwrite(region->fd, out, padded, offset);
+		if(wrote < 0 && errno == EINTR)
+			continue;
+		if(wrote <= 0)
+			error = NBT_ERROR_IO;
+		else {
+			out += wrote;
+			padded -= wrote;
+			offset += wrote;
+		}
+	}
+	if(!error) {
+		if(first + count > region->sectors)
+			region->sectors = first + count;
+		error = nbtRegionPutEntry(region, index * 4, first << 8 | count);
+	}
+	if(!error)
+		error = nbtRegionPutEntry(region, NBT_REGION_SECTOR + index * 4, time(NULL));
+	if(error && !(location && first == old_first))
+		nbtRegionMark(region, first, count, 0);
+	else if(!error && location) {
+		if(first == old_first)
+			nbtRegionMark(region, first + count, old_count - count, 0);
+		else
+			nbtRegionMark(region, old_first, old_count, 0);
+	}
+	pthread_mutex_unlock(&region->lock);
+	return error;
+}
+
+int nbtRegionSave(nbt_region* region, int x, int z, tag t, int compression, nbt_chunk* chunk) {
+	size_t size = nbtPeekLength(t);
+	if(nbtChunkReserve(&chunk->bytes, &chunk->capacity, size))
+		return NBT_ERROR_MEMORY;
+	nbtWrite(t, chunk->bytes);
+	chunk->size = size;
+	return nbtRegionWrite(region, x, z, chunk->bytes, size, compression, chunk);
+}
+
+int nbtRegionRemove(nbt_region* region, int x, int z) {
+	if(!region->used)
+		return NBT_ERROR_STATE;
+	uint32_t index = nbtRegionIndex(x, z);
+	pthread_mutex_lock(&region->lock);
+	uint32_t location = getUInt32((const char*)region->header + index * 4, NBT_FORMAT_BIG);
+	int error = NBT_OK;
+	if(location) {
+		error = nbtRegionPutEntry(region, index * 4, 0);
+		if(!error)
+			error = nbtRegionPutEntry(region, NBT_REGION_SECTOR + index * 4, 0);
+		if(!error)
+			error = nbtRegionMark(region, location >> 8, location & 0xff, 0);
+	}
+	pthread_mutex_unlock(&region->lock);
+	return error;
+}
+
+/*
+World scans
+Each region file is split into batches of NBT_SCAN_BATCH chunks, and threads claim the next unclaimed batch until none are left,
+so a thread that drew sparse or small chunks simply claims more batches. A thread keeps its region open while its batches stay in it.
+*/
+#define NBT_SCAN_BATCH 256
+#define NBT_SCAN_BATCHES (NBT_REGION_SIDE * NBT_REGION_SIDE / NBT_SCAN_BATCH) // Batches per region
+
+typedef struct nbt_scan_region_t {
+	char* path;
+	int x, z;
+} nbt_scan_region;
+
+typedef struct nbt_scan_job_t {
+	nbt_scan* scan;
+	nbt_scan_region* regions;
+	uint32_t count;
+	uint32_t batches;
+	uint32_t next; // First batch no thread has claimed yet
+	int stop;
+} nbt_scan_job;
+
+typedef struct nbt_scan_worker_t {
+	nbt_scan_job* job;
+	void* accumulator;
+	size_t chunks;
+	size_t failed;
+	pthread_t thread;
+} nbt_scan_worker;
+
+static void* nbtScanWorker(void* argument) {
+	nbt_scan_worker* worker = argument;
+	nbt_scan_job* job = worker->job;
+	nbt_arena arena;
+	nbtArenaInit(&arena, 0);
+	nbt_parser parser = {.arena = &arena, .flags = job->scan->flags};
+	nbt_chunk chunk = {0};
+	nbt_region region = {.fd = -1};
+	uint32_t open_region = UINT32_MAX;
+	uint32_t batch;
+	while(!__atomic_load_n(&job->stop, __ATOMIC_RELAXED) && (batch = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->batches) {
+		uint32_t r = batch / NBT_SCAN_BATCHES;
+		if(r != open_region) {
+			nbtRegionClose(&region);
+			open_region = r;
+			if(nbtRegionOpen(&region, job->regions[r].path)) {
+				worker->failed++;
+				continue;
+			}
+		}
+		if(!region.header)
+			continue;
+		uint32_t first = batch % NBT_SCAN_BATCHES * NBT_SCAN_BATCH;
+		for(uint32_t i = first; i < first + NBT_SCAN_BATCH; i++) {
+			int x = i % NBT_REGION_SIDE, z = i / NBT_REGION_SIDE;
+			if(!nbtRegionHasChunk(&region, x, z))
+				continue;
+			nbtArenaReset(&arena);
+			tag t;
+			if(nbtRegionRead(&region, &parser, x, z, &chunk, &t)) {
+				worker->failed++;
+				continue;
+			}
+			worker->chunks++;
+			if(job->scan->chunk(worker->accumulator, t, job->regions[r].x * NBT_REGION_SIDE + x, job->regions[r].z * NBT_REGION_SIDE + z, job->scan->context)) {
+				__atomic_store_n(&job->stop, 1, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+	}
+	nbtRegionClose(&region);
+	nbtChunkRelease(&chunk);
+	nbtArenaRelease(&arena);
+	return NULL;
+}
+
+int nbtScanWorld(const char* directory, nbt_scan* scan, void* result) {
+	scan->chunks = 0;
+	scan->failed = 0;
+	DIR* dir = opendir(directory);
+	if(!dir)
+		return NBT_ERROR_IO;
+	nbt_scan_job job = {scan};
+	uint32_t capacity = 0;
+	int error = NBT_OK;
+	struct dirent* entry;
+	while((entry = readdir(dir))) {
+		int x, z, end = 0;
+		if(sscanf(entry->d_name, "r.%d.%d.mca%n", &x, &z, &end) != 2 || !end || entry->d_name[end])
+			continue;
+		if(job.count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			nbt_scan_region* regions = realloc(job.regions, capacity * sizeof(nbt_scan_region));
+			if(!regions) {
+				error = NBT_ERROR_MEMORY;
+				break;
+			}
+			job.regions = regions;
+		}
+		nbt_scan_region* region = job.regions + job.count;
+		region->x = x;
+		region->z = z;
+		if(!(region->path = malloc(strlen(directory) + strlen(entry->d_name) + 2))) {
+			error = NBT_ERROR_MEMORY;
+			break;
+		}
+		sprintf(region->path, "%s/%s", directory, entry->d_name);
+		job.count++;
+	}
+	closedir(dir);
+	job.batches = job.count * NBT_SCAN_BATCHES;
+
+	int threads = scan->threads > 0 ? scan->threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1)
+		threads = 1;
+	nbt_scan_worker* workers = error ? NULL : calloc(threads, sizeof(nbt_scan_worker));
+	if(!workers && !error)
+		error = NBT_ERROR_MEMORY;
+	int started = 0;
+	for(int i = 0; i < threads && !error; i++) {
+		workers[i].job = &job;
+		if(scan->accumulator_size && !(workers[i].accumulator = calloc(1, scan->accumulator_size))) {
+			error = NBT_ERROR_MEMORY;
+			break;
+		}
+		// The first worker runs on this thread once the others are going
+		if(i && pthread_create(&workers[i].thread, NULL, nbtScanWorker, workers + i))
+			break;
+		started = i + 1;
+	}
+	if(error)
+		job.stop = 1;
+	if(started)
+		nbtScanWorker(workers);
+	for(int i = 0; i < started; i++) {
+		if(i)
+			pthread_join(workers[i].thread, NULL);
+		if(scan->merge)
+			scan->merge(result, workers[i].accumulator, scan->context);
+		scan->chunks += workers[i].chunks;
+		scan->failed += workers[i].failed;
+	}
+	if(workers)
+		for(int i = 0; i < threads; i++)
+			free(workers[i].accumulator);
+	free(workers);
+	for(uint32_t i = 0; i < job.count; i++)
+		free(job.regions[i].path);
+	free(job.regions);
+	return error;
+}
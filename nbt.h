@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <math.h>
 #include <string.h>
+#include <stdio.h>
+#include <pthread.h>
 #ifndef NBT_H
 #define NBT_H
 
@@ -24,22 +26,542 @@ union payload {
 	int64_t* asLongs;
 };
 
+/* Bits set in tag.flags */
+#define NBT_TAG_BORROWED 1 // name, and asString or asBytes payloads (and lazily read arrays), point into the buffer the tag was read from
+#define NBT_TAG_INDEXED 2 // A compound whose asCompound array is followed by a hash index of its children's names
+#define NBT_TAG_SWAPPED 4 // An int or long array left in the opposite byte order to the host, read its elements with nbtIntAt and nbtLongAt
+#define NBT_TAG_ARENA 8 // Read into an arena, nbtFree leaves it alone and the arena releases it
+#define NBT_TAG_POOLED 16 // Read while the thread's pool was on, nbtFree recycles its memory
+#define NBT_TAG_INTERNED 32 // name is shared from an nbt_intern table, which must outlive the tag
+
 typedef struct tag_t {
 	int8_t id;
+	uint8_t flags;
 	uint16_t name_length;
 	char* name;
 	uint32_t length; // For list type payloads, tells how many items are in the list, otherwise dictates payload size in bytes
 	union payload payload;
 } tag;
 
+/* One chunk of memory owned by an arena, allocations are bumped out of the bytes following it */
+typedef struct nbt_arena_block_t {
+	struct nbt_arena_block_t* next;
+	size_t size;
+	size_t used;
+} nbt_arena_block;
+
+/* A caller-owned bump allocator. Every tag read through it is released at once by nbtArenaReset or nbtArenaRelease */
+typedef struct nbt_arena_t {
+	nbt_arena_block* first;
+	nbt_arena_block* current;
+	size_t block_size; // Size of each new block, oversized allocations get a block of their own
+	size_t allocations; // How many allocations were served since the last reset
+} nbt_arena;
+
+/*
+A table of names shared between documents, safe to use from several threads at once.
+Parsers pointing at it give every name they read the table's one copy, so equal names are equal pointers. Names live until nbtInternRelease
+*/
+typedef struct nbt_intern_t {
+	nbt_arena strings;
+	char** slots; // Open addressed, each name is null terminated and preceded by its 16 bit length
+	size_t count;
+	size_t capacity;
+	pthread_mutex_t lock;
+} nbt_intern;
+
+/* Bits for nbt_parser.flags */
+/*
+Borrow names, strings and byte arrays straight from the input buffer instead of copying them.
+Borrowed strings are NOT null terminated, use name_length and length (or nbtName/nbtString) to read them.
+The input buffer must outlive the tag, and must not be modified while the tag is in use.
+*/
+#define NBT_READ_BORROW 1
+/* Build a name index for every compound with at least NBT_INDEX_MIN children while reading, so nbtGet on them is O(1) */
+#define NBT_READ_INDEX 2
+/*
+Leave int and long arrays in the byte order of the buffer, flagged NBT_TAG_SWAPPED, instead of converting them while reading.
+Worth it when most arrays are written back untouched, which is then a plain copy. With NBT_READ_BORROW the arrays aren't even copied
+*/
+#define NBT_READ_LAZY_ARRAYS 4
+
+/* Compounds smaller than this are never indexed, a linear scan beats hashing at that size */
+#define NBT_INDEX_MIN 8
+
+/* Lists need at least this many elements before they are considered for decoding on several threads */
+#define NBT_PARALLEL_MIN_ELEMENTS 64
+
+/*
+Encodings for nbt_parser.format, nbt_writer.format and the *Format functions.
+Java edition files are big endian, Bedrock edition files little endian. The tape, path queries and push parser always use the default
+*/
+#define NBT_FORMAT_DEFAULT 0 // Whatever the library was built for with NBT_ENDIANNESS, big endian unless told otherwise
+#define NBT_FORMAT_BIG 1
+#define NBT_FORMAT_LITTLE 2
+/*
+Bedrock's network encoding: ints and longs are zigzag varints, as are list and array lengths and every element of int and long arrays.
+Name and string lengths are unsigned varints, shorts, floats and doubles little endian
+*/
+#define NBT_FORMAT_VARINT 3
+
+/* Options for nbtReadWith. A zeroed parser behaves exactly like nbtRead */
+typedef struct nbt_parser_t {
+	nbt_arena* arena; // When set, every name, payload and child array is allocated from here instead of malloc
+	int flags; // NBT_READ_* bits
+	int threads; // Above 1, large lists of compounds, lists, strings or arrays have their elements decoded on this many threads
+	size_t parallel_threshold; // Lists smaller than this many bytes are always decoded on the calling thread
+	int format; // NBT_FORMAT_* encoding of the input
+	nbt_intern* intern; // When set, names come from this table instead of being copied or borrowed
+} nbt_parser;
+
+/* A length-delimited string, not necessarily null terminated */
+typedef struct nbt_string_t {
+	const char* data;
+	size_t length;
+} nbt_string;
+
+/* Result codes for functions that check their input */
+#define NBT_OK 0
+#define NBT_ERROR_TRUNCATED -1 // A length or payload runs past the end of the buffer
+#define NBT_ERROR_BAD_ID -2 // Unknown tag id, or a list of end tags that isn't empty
+#define NBT_ERROR_DEPTH -3 // Compounds and lists nested deeper than NBT_MAX_DEPTH
+#define NBT_ERROR_MEMORY -4
+#define NBT_ERROR_TOO_LARGE -5 // Buffer too big to address with 32 bit offsets, a varint or name longer than its type allows, or a chunk inflating past deflate's best ratio
+#define NBT_ERROR_IO -6 // A writer's file or descriptor refused the output
+#define NBT_ERROR_STATE -7 // Writer calls out of order, like a list element of the wrong type or an unbalanced nbtEnd
+#define NBT_ERROR_COMPRESSION -8 // A region chunk stored with an unsupported compression type, or that fails to decompress
+#define NBT_ERROR_ABSENT -9 // A region has no chunk at the requested position
+#define NBT_DONE 1 // A push parser reached the end of its document
+
+/* Deepest nesting of compounds and lists accepted from a buffer, same as the game itself */
+#define NBT_MAX_DEPTH 512
+
+/*
+A structural index of a serialized buffer, with one entry per tag, built in one pass without allocating per tag.
+Entries are laid out in document order, a compound or list's children follow it directly, and next skips its whole subtree.
+Elements of lists of fixed size payloads (bytes through doubles) get no entries, they can be located by arithmetic.
+*/
+typedef struct nbt_tape_entry_t {
+	int8_t id;
+	uint16_t name_length;
+	uint32_t name; // Offset of the name, 0 for list elements which have none
+	uint32_t payload; // Offset of the payload
+	uint32_t end; // Offset one past the last byte of the payload
+	uint32_t next; // Index of the entry after this tag's subtree
+	uint32_t length; // Same meaning as tag.length
+} nbt_tape_entry;
+
+/* Zero initialize before the first nbtTapeBuild, the entry buffer is reused between builds */
+typedef struct nbt_tape_t {
+	const char* bytes;
+	size_t size;
+	nbt_tape_entry* entries;
+	uint32_t count;
+	uint32_t capacity;
+} nbt_tape;
+
+/* Returned by tape lookups that find nothing */
+#define NBT_TAPE_NONE UINT32_MAX
+
+/*
+A compact copy of a document, nodes are 16 bytes and a compound or list's children sit next to each other in the node array.
+Names are deduplicated into one table, and lists of numbers are packed into native arrays like the array types are.
+*/
+typedef struct nbt_node_t {
+	int8_t id;
+	int8_t element; // Element type of a list
+	uint16_t name_length;
+	uint32_t name; // Offset of the name in the doc's string table, null terminated
+	uint32_t length; // Same meaning as tag.length
+	uint32_t value; // Bytes, shorts, ints and floats themselves, the first child of compounds and lists of non-numbers, otherwise an offset into data
+} nbt_node;
+
+/* Zero initialize before the first nbtDocBuild, set format first for other encodings. Every buffer is reused between builds */
+typedef struct nbt_doc_t {
+	nbt_node* nodes;
+	uint32_t count;
+	size_t capacity;
+	char* strings;
+	size_t strings_size, strings_capacity;
+	char* data; // Longs, doubles, strings and arrays in host byte order
+	size_t data_size, data_capacity;
+	nbt_node* scratch; // Children of the compounds being built
+	size_t scratch_count, scratch_capacity;
+	uint32_t* names; // Hash table of string table offset + 1
+	size_t names_used, names_capacity;
+	int format; // NBT_FORMAT_* encoding of the input
+} nbt_doc;
+
+/* Returned by node lookups that find nothing */
+#define NBT_NODE_NONE UINT32_MAX
+
+/*
+A compiled path expression for nbtQuery, like "Level.Sections[*].BlockStates"
+Names are separated by '.', and may be followed by any number of [index] or [*] to pick one or every element of a list or array.
+The path is applied starting from the root compound, whose own name is ignored.
+*/
+#define NBT_PATH_MAX_STEPS 32
+#define NBT_PATH_NAME 0
+#define NBT_PATH_INDEX 1
+#define NBT_PATH_ALL 2
+
+typedef struct nbt_path_step_t {
+	int kind; // NBT_PATH_NAME, NBT_PATH_INDEX or NBT_PATH_ALL
+	const char* name; // Points into the expression the path was compiled from
+	size_t name_length;
+	uint32_t index;
+} nbt_path_step;
+
+typedef struct nbt_path_t {
+	nbt_path_step steps[NBT_PATH_MAX_STEPS];
+	int count;
+} nbt_path;
+
+/* A payload matched by nbtQuery */
+typedef struct nbt_match_t {
+	int8_t id; // Type of the payload, elements of arrays are reported as bytes, ints or longs
+	size_t offset; // Where the payload starts, including any length prefix
+	size_t length; // Size of the payload in bytes
+} nbt_match;
+
+/* Events reported by the push parser */
+#define NBT_EVENT_KEY 1 // The name of the tag that the next event belongs to, in data and length
+#define NBT_EVENT_VALUE 2 // A scalar in value, or a string in data and length
+#define NBT_EVENT_ARRAY 3 // A run of array elements, in host byte order, in data and length. index is the first element's position in the array
+#define NBT_EVENT_BEGIN_COMPOUND 4
+#define NBT_EVENT_BEGIN_LIST 5 // id is the type of the list's elements
+#define NBT_EVENT_END 6 // Closes the most recent compound or list
+
+typedef struct nbt_event_t {
+	int type; // NBT_EVENT_*
+	int8_t id; // Type of the value, array, or list elements
+	uint32_t count; // Number of elements in a list or array
+	uint32_t index;
+	const char* data; // Only valid for the duration of the handler call
+	size_t length;
+	union payload value;
+} nbt_event;
+
+/* Called for every event, returning anything but 0 stops the parser, and nbtPushFeed returns that value */
+typedef int (*nbt_event_handler)(void* user, const nbt_event* event);
+
+/* One open compound or list of a push parser */
+typedef struct nbt_push_frame_t {
+	int8_t id;
+	int8_t element;
+	uint32_t remaining;
+} nbt_push_frame;
+
+/*
+A resumable parser that turns arbitrarily sliced input into events, without ever needing the whole document.
+Its working set is fixed, the depth stack plus a scratch buffer no larger than the longest string or key.
+*/
+typedef struct nbt_push_parser_t {
+	nbt_event_handler handler;
+	void* user;
+	int state;
+	int8_t id; // Type of the payload being read
+	uint32_t need; // Size of the field being gathered
+	uint32_t have; // How much of it is gathered in scratch
+	uint32_t count; // Length of the array being read
+	uint32_t index; // Next element of the array
+	char* scratch;
+	size_t scratch_size;
+	size_t used; // How much of the last slice was consumed, less than its size if the document ended inside it
+	int depth;
+	nbt_push_frame frames[NBT_MAX_DEPTH];
+} nbt_push_parser;
+
+/* One open compound or list of a writer */
+typedef struct nbt_writer_frame_t {
+	int8_t id;
+	int8_t element;
+	uint32_t remaining;
+} nbt_writer_frame;
+
+/*
+Serializes a document in a single pass as it is described through nbtBeginCompound, nbtPutInt, ... and nbtEnd, with no tag tree involved.
+Output either accumulates in buffer, or goes to a FILE* or file descriptor whenever buffer fills up.
+Inside lists the name arguments are ignored. Errors are sticky, every call after the first error returns it again.
+*/
+typedef struct nbt_writer_t {
+	char* buffer; // Everything written so far when writing to memory, free it or take ownership of it once finished
+	size_t size;
+	size_t capacity;
+	FILE* file;
+	int fd; // -1 when not writing to a descriptor
+	int error;
+	int done; // Set once the root tag is complete
+	int format; // NBT_FORMAT_* encoding of the output, reset by nbtWriterInit* so set it afterwards
+	int depth;
+	nbt_writer_frame frames[NBT_MAX_DEPTH];
+} nbt_writer;
+
+/* A read-only memory mapping of a whole file */
+typedef struct nbt_map_t {
+	const char* bytes;
+	size_t size;
+} nbt_map;
+
+/*
+Anvil region files (.mca), 32 by 32 chunks each. A header of 4 KiB of chunk locations and 4 KiB of timestamps is followed by
+the chunks themselves, each in whole 4 KiB sectors, as a big endian length, a compression type byte and the compressed document
+*/
+#define NBT_REGION_SIDE 32
+#define NBT_REGION_SECTOR 4096
+#define NBT_REGION_HEADER 8192
+/* Compression types of region chunks */
+#define NBT_COMPRESSION_GZIP 1
+#define NBT_COMPRESSION_ZLIB 2
+#define NBT_COMPRESSION_NONE 3
+
+/*
+An open region file. Reads go through pread and the mapped header, so any number of threads may read from one region at once.
+Writes are serialized by the region's lock, but a chunk must not be read while it is being rewritten
+*/
+typedef struct nbt_region_t {
+	int fd;
+	const uint8_t* header; // Mapped location table followed by the timestamp table
+	uint64_t* used; // One bit per sector in use, only when opened for writing
+	uint32_t sectors; // Sectors in the file, new chunks that fit nowhere else go here
+	uint32_t used_capacity; // Sectors the used bitmap has room for
+	pthread_mutex_t lock;
+} nbt_region;
+
+/* One thread's scratch space for reading region chunks, zero initialize before the first read. Every buffer is reused between reads */
+typedef struct nbt_chunk_t {
+	char* bytes; // The decompressed document
+	size_t size;
+	size_t capacity;
+	char* compressed;
+	size_t compressed_capacity;
+	void* stream; // zlib's inflate state, reset rather than rebuilt for every chunk
+	void* deflater; // zlib's deflate state for writes, likewise
+	int deflater_type; // NBT_COMPRESSION_* the deflate state was set up for
+} nbt_chunk;
+
+/*
+Called by nbtScanWorld for every chunk in a world, with the calling thread's own accumulator and the chunk's world coordinates.
+The tag is read into an arena that is reset after the callback returns. Return non-zero to stop the scan early
+*/
+typedef int (*nbt_scan_chunk)(void* accumulator, tag chunk, int x, int z, void* context);
+/* Fold one thread's accumulator into the result, called on the thread that started the scan once every worker is done */
+typedef void (*nbt_scan_merge)(void* result, const void* accumulator, void* context);
+
+/* A map-reduce over every chunk of every region file in a directory */
+typedef struct nbt_scan_t {
+	nbt_scan_chunk chunk;
+	nbt_scan_merge merge;
+	void* context;
+	size_t accumulator_size; // Every thread gets a zeroed accumulator of this size
+	int threads; // 0 uses one thread per online CPU
+	int flags; // NBT_READ_* bits for reading each chunk
+	size_t chunks; // Chunks read, set by nbtScanWorld
+	size_t failed; // Chunks that could not be read or decompressed, set by nbtScanWorld
+} nbt_scan;
+
+/* The name of a tag, valid whether it was copied or borrowed */
+nbt_string nbtName(tag tag);
+/* The contents of a string tag, valid whether it was copied or borrowed */
+nbt_string nbtString(tag tag);
+/* Compare a tag's name to a length-delimited string */
+int nbtNameEquals(tag tag, const char* name, size_t length);
 /* Retrieve a tag from a given compound tag payload */
-tag nbtPayloadGet(const struct tag_t* const compound, int8_t compound_length, const char* const name);
-/* Retrieve a tag from a given compound tag */
+tag nbtPayloadGet(const struct tag_t* const compound, uint32_t compound_length, const char* const name);
+/* Retrieve a tag from a given compound tag, using its name index if it has one */
 tag nbtGet(tag compoundTag, const char* const name);
+/* Return a tag from a compound read with an intern table, by a name from nbtIntern on that same table. Only compares pointers */
+tag nbtGetInterned(tag compoundTag, const char* name);
+/* Retrieve a tag from a given compound tag, building its name index on first use. Only for malloc'd trees, arena trees should be read with NBT_READ_INDEX */
+tag nbtLookup(tag* compoundTag, const char* const name);
+/* Build a name index for a malloc'd compound tag, returns 0 on success. The children keep their order. Arena tags are refused */
+int nbtIndex(tag* compoundTag);
+/* Element i of an int or long array tag in host byte order, whether or not it was read with NBT_READ_LAZY_ARRAYS */
+int32_t nbtIntAt(tag array, uint32_t i);
+int64_t nbtLongAt(tag array, uint32_t i);
+/* Overwrite element i of an int or long array tag, in whichever byte order it is kept. Borrowed arrays are read-only */
+void nbtSetIntAt(tag* array, uint32_t i, int32_t value);
+void nbtSetLongAt(tag* array, uint32_t i, int64_t value);
 /* Read a tag from a given byte string */
 tag nbtRead(const char* bytes);
+/* Read a tag from a given byte string, allocating as the parser is configured to */
+tag nbtReadWith(nbt_parser* parser, const char* bytes);
+/*
+Release everything a tag owns and zero it. Borrowed names and payloads are left alone, as are tags read into an arena.
+Hand-built tags are expected to hold malloc'd names and payloads, like nbtRead's
+*/
+void nbtFree(tag* tag);
+/* Release a tag's payload and children, keeping its id and name */
+void nbtClear(tag* tag);
+/*
+Turn on this thread's pool: reads on the thread without an arena take memory from it, and nbtFree gives it back, keeping up to limit bytes for the next read.
+Steady-state reading and freeing then barely touches the system allocator
+*/
+void nbtPoolInit(size_t limit);
+/* Turn this thread's pool off and free the memory it kept. Pooled tags still alive can be freed afterwards as usual */
+void nbtPoolRelease(void);
 /* Write a tag into a given byte string */
 char* nbtWrite(tag tag, char* bytes);
+/* Write a tag into a given byte string in one of the NBT_FORMAT_* encodings */
+char* nbtWriteFormat(tag tag, char* bytes, int format);
 /* Tally up how many bytes a tag needs in order to be written */
 size_t nbtPeekLength(tag tag);
+/* Tally up how many bytes a tag needs in order to be written in one of the NBT_FORMAT_* encodings */
+size_t nbtPeekLengthFormat(tag tag, int format);
+
+/* Index every tag in a buffer of size bytes, checking bounds as it goes. The buffer must outlive the tape. Returns NBT_OK or an NBT_ERROR_* code */
+int nbtTapeBuild(nbt_tape* tape, const char* bytes, size_t size);
+/* Free a tape's entries */
+void nbtTapeRelease(nbt_tape* tape);
+/* Find the entry of a compound entry's child by name */
+uint32_t nbtTapeChild(const nbt_tape* tape, uint32_t compound, const char* name);
+/* Find the entry of the i'th element of a list entry, NBT_TAPE_NONE for lists of fixed size payloads */
+uint32_t nbtTapeElement(const nbt_tape* tape, uint32_t list, uint32_t i);
+/* Materialize the subtree of a tape entry into a tag, only that subtree's bytes are decoded */
+tag nbtTapeRead(const nbt_tape* tape, nbt_parser* parser, uint32_t entry);
+
+/* Build a compact document from a serialized buffer, trusting it like nbtRead does. Returns NBT_OK or NBT_ERROR_MEMORY */
+int nbtDocBuild(nbt_doc* doc, const char* bytes);
+/* Free a document's buffers */
+void nbtDocRelease(nbt_doc* doc);
+/* Bytes taken by a document's nodes, names and data, not counting spare capacity */
+size_t nbtDocMemory(const nbt_doc* doc);
+/* The root node of a document, nodes are stored children first so it comes last */
+uint32_t nbtDocRoot(const nbt_doc* doc);
+/* A node's name, empty for list elements */
+nbt_string nbtNodeName(const nbt_doc* doc, uint32_t node);
+/* Find a compound node's child by name */
+uint32_t nbtNodeChild(const nbt_doc* doc, uint32_t compound, const char* name);
+/* Find the i'th child of a compound or element of a list node, NBT_NODE_NONE for lists of numbers, use nbtNodeData for those */
+uint32_t nbtNodeElement(const nbt_doc* doc, uint32_t node, uint32_t i);
+/* The value of a byte, short, int or long node */
+int64_t nbtNodeInt(const nbt_doc* doc, uint32_t node);
+/* The value of a float or double node */
+double nbtNodeFloat(const nbt_doc* doc, uint32_t node);
+/* The value of a string node */
+nbt_string nbtNodeString(const nbt_doc* doc, uint32_t node);
+/* The native array behind an array node or a list of numbers, NULL for anything else */
+const void* nbtNodeData(const nbt_doc* doc, uint32_t node);
+
+/*
+Check a whole document in one pass without allocating: every length against the buffer size, every tag id, list element types and nesting depth.
+Returns the offset one past the end of the root tag, or an NBT_ERROR_* code
+*/
+int64_t nbtValidate(const char* bytes, size_t size);
+/* nbtValidate for a document in one of the NBT_FORMAT_* encodings */
+int64_t nbtValidateFormat(const char* bytes, size_t size, int format);
+/* Check and skip a single payload of the given type at the start of bytes, returns where it ends or an NBT_ERROR_* code */
+int64_t nbtSkip(const char* bytes, size_t size, int8_t type);
+
+/* Compile a path expression, which must outlive the path. Returns 0, or -1 if the expression is malformed */
+int nbtPathCompile(nbt_path* path, const char* expression);
+/*
+Find every payload matching a path in a serialized buffer, without reading it into tags. Subtrees that can't match are skipped over by their lengths.
+Up to capacity matches are stored, and the total number found is returned, or an NBT_ERROR_* code if the buffer is malformed
+*/
+long nbtQuery(const char* bytes, size_t size, const nbt_path* path, nbt_match* matches, size_t capacity);
+
+/* Prepare a push parser to report events of a new document to handler. Zero initialize it before the first call, its scratch buffer is kept between documents */
+void nbtPushInit(nbt_push_parser* parser, nbt_event_handler handler, void* user);
+/* Feed the next slice of a document. Returns NBT_OK when more input is needed, NBT_DONE once the document is complete, or an error */
+int nbtPushFeed(nbt_push_parser* parser, const char* bytes, size_t size);
+/* Free a push parser's scratch buffer */
+void nbtPushRelease(nbt_push_parser* parser);
+
+/* Prepare a writer that accumulates its output in memory */
+void nbtWriterInit(nbt_writer* writer);
+/* Prepare a writer that streams its output to a file */
+void nbtWriterInitFile(nbt_writer* writer, FILE* file);
+/* Prepare a writer that streams its output to a file descriptor */
+void nbtWriterInitFd(nbt_writer* writer, int fd);
+/* Flush anything still buffered, returns NBT_OK if a complete document was written, or the error that stopped it */
+int nbtWriterFinish(nbt_writer* writer);
+/* Free the writer's buffer */
+void nbtWriterRelease(nbt_writer* writer);
+/* Open a compound, closed by nbtEnd */
+int nbtBeginCompound(nbt_writer* writer, const char* name);
+/* Open a list of count elements of type element, closed by nbtEnd once all of them are written */
+int nbtBeginList(nbt_writer* writer, const char* name, int8_t element, uint32_t count);
+/* Close the innermost open compound or list */
+int nbtEnd(nbt_writer* writer);
+int nbtPutByte(nbt_writer* writer, const char* name, int8_t value);
+int nbtPutShort(nbt_writer* writer, const char* name, int16_t value);
+int nbtPutInt(nbt_writer* writer, const char* name, int32_t value);
+int nbtPutLong(nbt_writer* writer, const char* name, int64_t value);
+int nbtPutFloat(nbt_writer* writer, const char* name, _Float32 value);
+int nbtPutDouble(nbt_writer* writer, const char* name, _Float64 value);
+int nbtPutString(nbt_writer* writer, const char* name, const char* value, size_t length);
+int nbtPutByteArray(nbt_writer* writer, const char* name, const int8_t* values, uint32_t count);
+int nbtPutIntArray(nbt_writer* writer, const char* name, const int32_t* values, uint32_t count);
+int nbtPutLongArray(nbt_writer* writer, const char* name, const int64_t* values, uint32_t count);
+
+/* Map an uncompressed NBT file read-only, hinting the kernel that it will be read through sequentially. Returns NBT_OK or NBT_ERROR_IO */
+int nbtMapFile(nbt_map* map, const char* path);
+/* Unmap a file, any tags borrowed from it become invalid */
+void nbtUnmapFile(nbt_map* map);
+/*
+Map a file, check it is well formed, and read it into a tag. On success the mapping is left in map for the caller to nbtUnmapFile,
+which can be done straight away unless the parser borrows from it. Returns NBT_OK or an NBT_ERROR_* code, with nothing left mapped
+*/
+int nbtReadFile(nbt_parser* parser, const char* path, nbt_map* map, tag* out);
+
+/* Open a region file for reading, mapping only its header. Returns NBT_OK, NBT_ERROR_IO or NBT_ERROR_TRUNCATED for files too short to hold a header */
+int nbtRegionOpen(nbt_region* region, const char* path);
+/* Unmap a region's header and close it */
+void nbtRegionClose(nbt_region* region);
+/* Whether a region holds chunk x, z. Chunk coordinates are taken modulo 32, so world chunk coordinates work too */
+int nbtRegionHasChunk(const nbt_region* region, int x, int z);
+/* When chunk x, z was last saved, in seconds since the epoch */
+uint32_t nbtRegionTimestamp(const nbt_region* region, int x, int z);
+/* Read and decompress chunk x, z into chunk->bytes. Returns NBT_OK or an NBT_ERROR_* code */
+int nbtRegionLoad(const nbt_region* region, int x, int z, nbt_chunk* chunk);
+/*
+Load chunk x, z, check it is well formed, and read it into a tag. A parser that borrows borrows from chunk->bytes,
+which the next read through the same chunk overwrites. Returns NBT_OK or an NBT_ERROR_* code
+*/
+int nbtRegionRead(const nbt_region* region, nbt_parser* parser, int x, int z, nbt_chunk* chunk, tag* out);
+/* Free a chunk's buffers and zlib state */
+void nbtChunkRelease(nbt_chunk* chunk);
+/*
+Open a region file for reading and writing, creating an empty one if it doesn't exist, and find its free sectors from the header.
+Returns NBT_OK, NBT_ERROR_IO or NBT_ERROR_TRUNCATED
+*/
+int nbtRegionOpenWrite(nbt_region* region, const char* path);
+/*
+Compress a serialized document and store it as chunk x, z, with chunk's buffers as scratch space.
+The chunk is rewritten in place when it still fits its sectors, otherwise moved to the first free run of sectors or the end of the file.
+Only the chunk's sectors and its 4 byte location and timestamp entries are written. Returns NBT_OK or an NBT_ERROR_* code
+*/
+int nbtRegionWrite(nbt_region* region, int x, int z, const char* bytes, size_t size, int compression, nbt_chunk* chunk);
+/* Serialize a tag into chunk->bytes, then nbtRegionWrite it */
+int nbtRegionSave(nbt_region* region, int x, int z, tag t, int compression, nbt_chunk* chunk);
+/* Remove chunk x, z from a region, freeing its sectors for later writes */
+int nbtRegionRemove(nbt_region* region, int x, int z);
+
+/*
+Run scan->chunk over every chunk of every r.X.Z.mca file in a directory, reading, decompressing and parsing on scan->threads threads,
+then merge every thread's accumulator into result. Returns NBT_OK, NBT_ERROR_IO when the directory can't be listed, or NBT_ERROR_MEMORY
+*/
+int nbtScanWorld(const char* directory, nbt_scan* scan, void* result);
+
+/* Reverse the byte order of count 16, 32 or 64 bit elements from src into dst, which may be the same buffer. Vectorized where the CPU allows */
+void nbtByteSwap16(void* dst, const void* src, size_t count);
+void nbtByteSwap32(void* dst, const void* src, size_t count);
+void nbtByteSwap64(void* dst, const void* src, size_t count);
+
+/* Prepare an empty arena, block_size of 0 picks a default */
+void nbtArenaInit(nbt_arena* arena, size_t block_size);
+/* Bump an 8 byte aligned allocation out of the arena */
+void* nbtArenaAlloc(nbt_arena* arena, size_t size);
+/* Invalidate everything allocated so far, but keep the blocks around for the next document */
+void nbtArenaReset(nbt_arena* arena);
+/* Hand every block back to the system */
+void nbtArenaRelease(nbt_arena* arena);
+
+/* Set up an empty intern table */
+void nbtInternInit(nbt_intern* table);
+/* The table's copy of a name, added if it's new. NULL when out of memory */
+const char* nbtIntern(nbt_intern* table, const char* name, size_t length);
+/* Free every name in the table, no tag read with it may be used afterwards */
+void nbtInternRelease(nbt_intern* table);
 #endif
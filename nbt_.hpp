@@ -27,6 +27,7 @@ Preprocessor options:
 NBT_COMPILE - Allows access to 'compilation' functions, that return a string detailing the contents of a tag. Helpful for debugging.
 NBT_COMPILE_FULL_ARRAYS - By default, any array tags will say "ArrayTag(100 elements)" instead of listing each element individually. If you wish to see each element, define this.
 NBT_LITTLE_ENDIAN - Uses Little Endian to represent data, rather than the default Big Endian
+NBT_RAW_ARRAYS - primitivearraytag::data keeps elements in file byte order, so loading and writing arrays is a single memcpy. Use at(), set() and [] to get host order values
 NBT_SHORTHAND - In order to interact with different forms of data, tag_p will dynamic_cast from a tag pointer, to a specific tag reference. Shorthand adds extra shorter functions to allow you to call "tag_p.i()" or "tag_p.it()" instead of "tag_p._int()" or "tag_p._inttag()"
 NBT_THROW_ENDLESS - Enables an exception to be thrown whenever a compound tag attempts to write it's data when it doesn't have an end tag.
 NBT_IGNORE_MUTF - Ignores the "Modified UTF-8" specification, and instead only deals in the base UTF-8 standard, default C++ string.
@@ -492,6 +493,7 @@ namespace nbt {
 	};
 
 	// Similar to primitivetag, but storing arrays (vectors) of primitive types instead of a single instance.
+	// With NBT_RAW_ARRAYS, data holds the elements as they are in the file, and is only swapped one element at a time through at() and set()
 	template <typename T, int8_t ID>
 	class primitivearraytag : public tag {
 	public:
@@ -501,18 +503,18 @@ namespace nbt {
 			id = correct_tag();
 		}
 		primitivearraytag(std::vector<T> data) : primitivearraytag() {
-			this->data = data;
+			assign(data);
 		}
 		primitivearraytag(std::string name) : primitivearraytag() {
 			this->data = std::vector<T>();
 			this->name = name;
 		}
 		primitivearraytag(std::string name, std::vector<T> data) : primitivearraytag() {
-			this->data = data;
+			assign(data);
 			this->name = name;
 		}
 		primitivearraytag(std::vector<T> data, std::string name) : primitivearraytag() {
-			this->data = data;
+			assign(data);
 			this->name = name;
 		}
 		primitivearraytag(const tag* const tag) : primitivearraytag() {
@@ -522,6 +524,34 @@ namespace nbt {
 			this->name = t->name;
 		}
 
+		// Element i in host byte order
+		T at(size_t i) const {
+#ifdef NBT_RAW_ARRAYS
+			T out;
+			fromBytes((const char*)&data[i], &out);
+			return out;
+#else
+			return data[i];
+#endif
+		}
+		void set(size_t i, T value) {
+#ifdef NBT_RAW_ARRAYS
+			toBytes(value, (char*)&data[i]);
+#else
+			data[i] = value;
+#endif
+		}
+		// Replace every element with host byte order values
+		void assign(const std::vector<T>& values) {
+#ifdef NBT_RAW_ARRAYS
+			data.resize(values.size());
+			for (size_t i = 0; i < values.size(); i++)
+				set(i, values[i]);
+#else
+			data = values;
+#endif
+		}
+
 		size_t load(const char* const bytes, size_t offset) {
 			size_t off = loadDefault(bytes, offset);
 
@@ -533,6 +563,12 @@ namespace nbt {
 			// Edit offset for simplicity
 			off += 4;
 
+#ifdef NBT_RAW_ARRAYS
+			// Elements stay in file byte order until they are accessed
+			data.resize(length);
+			memcpy(data.data(), &bytes[off], length * sizeof(T));
+			return off + length * sizeof(T);
+#endif
 			// Loop through each element and push them into data
 			for (uint32_t i = 0; i < length; i++) {
 				// Add the current data into the list, and change the offset for the next loop
@@ -550,6 +586,10 @@ namespace nbt {
 			// Convert the length into byte form, and copy it to the buffer
 			toBytes((uint32_t)data.size(), &buffer[off]);
 			off += 4;
+#ifdef NBT_RAW_ARRAYS
+			memcpy(&buffer[off], data.data(), data.size() * sizeof(T));
+			return off + data.size() * sizeof(T);
+#endif
 			// Loop through all elements of data and copy them into the buffer
 			for (int i = 0; i < data.size(); i++) {
 				toBytes(data[i], &buffer[off]);
@@ -567,6 +607,10 @@ namespace nbt {
 			// Convert the length into byte form, and copy it to the buffer
 			toBytes((uint32_t)data.size(), &buffer[off]);
 			off += 4;
+#ifdef NBT_RAW_ARRAYS
+			memcpy(&buffer[off], data.data(), data.size() * sizeof(T));
+			return buffer.size();
+#endif
 			// Loop through all elements of data and copy them into the buffer
 			for (int i = 0; i < data.size(); i++) {
 				toBytes(data[i], &buffer[off]);
@@ -584,6 +628,10 @@ namespace nbt {
 			// Convert the length into byte form, and copy it to the buffer
 			toBytes((uint32_t)data.size(), &out[0]);
 			int off = 4;
+#ifdef NBT_RAW_ARRAYS
+			memcpy(&out[off], data.data(), data.size() * sizeof(T));
+			return out;
+#endif
 			// Loop through all elements of data and copy them into the buffer
 			for (int i = 0; i < data.size(); i++) {
 				toBytes(data[i], &out[off]);
@@ -602,12 +650,22 @@ namespace nbt {
 		// Not sure why this operator isn't used by vectors and stack-like data structures in general, tbh.
 		void operator<<(T t) {
 			data.push_back(t);		
+#ifdef NBT_RAW_ARRAYS
+			set(data.size() - 1, t);
+#endif
 		}
 		T operator[](size_t i) {
-			return data[i];
+			return at(i);
 		}
 		operator std::vector<T>() {
+#ifdef NBT_RAW_ARRAYS
+			std::vector<T> out = std::vector<T>(data.size());
+			for (size_t i = 0; i < data.size(); i++)
+				out[i] = at(i);
+			return out;
+#else
 			return data;
+#endif
 		}
 
 		const int8_t correct_tag() {
@@ -632,7 +690,7 @@ namespace nbt {
 #ifdef NBT_COMPILE_FULL_ARRAYS
 			// By default, arrays don't spew out their contents when being printed, but it is an option you can toggle on.
 			for (unsigned int i = 0; i < data.size(); i++) {
-				out += regex + "\t" + std::to_string(data[i]) + "\n";
+				out += regex + "\t" + std::to_string(at(i)) + "\n";
 			}
 #endif
 			return out;
@@ -1285,6 +1343,174 @@ namespace nbt {
 #endif
 	};
 
+	/*
+	Loads a compound from a document fed in one slice at a time, like the windows coming out of an inflater, instead of from one whole buffer.
+	Only the tag currently being read is kept, so beyond the tree itself memory stays at about one slice plus the largest string or array.
+	Each string, array and number goes through its tag's usual load(). Tags registered with registerTag are not supported, as their sizes aren't known.
+	A document that stops short leaves a partial compound behind: inflateInto reports that as Z_DATA_ERROR, when feeding by hand check done() at the end.
+	*/
+	class loader {
+	public:
+		loader(compound* root) {
+			registerDefaultTags();
+			this->root = root;
+			pending.resize(slack);
+		}
+		// Feed the next slice of the document, returns true once the root compound is complete. Anything after the root is ignored
+		bool feed(const char* bytes, size_t length) {
+			if (finished)
+				return true;
+			// Drop the consumed bytes once they outweigh the rest, keeping slack in front for list elements' stand-in headers
+			if (start - slack >= filled - start) {
+				memmove(&pending[slack], &pending[start], filled - start);
+				filled -= start - slack;
+				start = slack;
+			}
+			if (pending.size() < filled + length)
+				pending.resize(filled + length);
+			memcpy(&pending[filled], bytes, length);
+			filled += length;
+			while (!finished && step());
+			return finished;
+		}
+		bool done() {
+			return finished;
+		}
+
+	private:
+		struct frame {
+			tag* container;
+			int8_t element; // Type of a list's elements
+			uint32_t remaining; // Elements left in a list
+		};
+		// Bytes kept in front of the unread data, list elements are given a header there so their load() can read them
+		static const size_t slack = 3;
+		compound* root;
+		std::vector<frame> frames;
+		std::vector<char> pending;
+		size_t start = slack, filled = slack;
+		bool finished = false;
+
+		// Bytes in the payload of a string, array or number, or 0 if its length isn't buffered yet
+		static size_t payloadSize(int8_t type, const char* bytes, size_t available) {
+			uint32_t count = 0;
+			switch (type < 0 ? -type : type) {
+			case 1: return 1;
+			case 2: return 2;
+			case 3: case 5: return 4;
+			case 4: case 6: return 8;
+			case 8: {
+				if (available < 2)
+					return 0;
+				uint16_t length = 0;
+				fromBytes(bytes, &length);
+				return 2 + (size_t)length;
+			}
+			case 7: case 11: case 12:
+				if (available < 4)
+					return 0;
+				fromBytes(bytes, &count);
+				return 4 + (size_t)count * ((type < 0 ? -type : type) == 7 ? 1 : type == 11 || type == -11 ? 4 : 8);
+			}
+			throw missing_tag_id_exception(type);
+		}
+		void attach(frame& parent, tag* t) {
+			if (parent.container->id == 10)
+				dynamic_cast<compound*>(parent.container)->tags.insert(std::make_pair(t->name, t));
+			else {
+				dynamic_cast<list*>(parent.container)->tags.push_back(t);
+				parent.remaining--;
+			}
+		}
+		// Read one header, tag or end out of the buffered bytes, returns false when more input is needed first
+		bool step() {
+			const char* bytes = &pending[start];
+			size_t available = filled - start;
+			uint16_t namelength = 0;
+			if (frames.empty()) {
+				if (available < 3)
+					return false;
+				fromBytes(&bytes[1], &namelength);
+				if (available < 3u + namelength)
+					return false;
+				if (bytes[0] != 10)
+					throw invalid_tag_id_exception(bytes[0], 10);
+				root->name = mutfToUtf(std::string(&bytes[3], namelength));
+				frames.push_back({ root, 0, 0 });
+				start += 3 + namelength;
+				return true;
+			}
+
+			// Children of compounds have a header, elements of lists don't
+			size_t header = 0;
+			int8_t type;
+			if (frames.back().container->id == 10) {
+				if (available < 1)
+					return false;
+				type = bytes[0];
+				if (type == 0) {
+					dynamic_cast<compound*>(frames.back().container)->tags.insert(std::make_pair(NBT_END_TAG_NAME, new end()));
+					frames.pop_back();
+					finished = frames.empty();
+					start++;
+					return true;
+				}
+				if (available < 3)
+					return false;
+				fromBytes(&bytes[1], &namelength);
+				header = 3 + namelength;
+				if (available < header)
+					return false;
+			}
+			else {
+				if (frames.back().remaining == 0) {
+					frames.pop_back();
+					return true;
+				}
+				type = frames.back().element;
+			}
+			if (tagConstructors.find(type) == tagConstructors.end())
+				throw missing_tag_id_exception(type);
+
+			// Compounds and lists stay open while their contents arrive
+			if (type == 9 || type == 10) {
+				if (available < header + (type == 9 ? 5 : 0))
+					return false;
+				frame open = { type == 9 ? (tag*)new list() : (tag*)new compound(), 0, 0 };
+				if (header)
+					open.container->name = mutfToUtf(std::string(&bytes[3], namelength));
+				if (type == 9) {
+					open.element = bytes[header];
+					fromBytes(&bytes[header + 1], &open.remaining);
+					dynamic_cast<list*>(open.container)->tag_type = open.element;
+					header += 5;
+				}
+				attach(frames.back(), open.container);
+				frames.push_back(open);
+				start += header;
+				return true;
+			}
+
+			// Anything else is loaded whole, once all of it is buffered
+			size_t size = payloadSize(type, &bytes[header], available - header);
+			if (size == 0 || available < header + size)
+				return false;
+			size_t at = start;
+			if (!header) {
+				// The same stand-in header list::load gives its elements
+				at -= 3;
+				pending[at] = NBT_BYPASS_ID;
+				pending[at + 1] = 0;
+				pending[at + 2] = 0;
+			}
+			tag* t = (*tagConstructors[type])();
+			t->load(&pending[0], at);
+			attach(frames.back(), t);
+			start += header + size;
+			return true;
+		}
+	};
+
 #ifdef NBT_SHORTHAND
 	typedef bytetag bt;
 	typedef ubytetag ubt;
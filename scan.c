@@ -0,0 +1,82 @@
+#include "nbt.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+Takes a census of every chunk in a world's region directory with nbtScanWorld: how many tags of each type it holds, and which chunk is the largest.
+
+usage: nbt-scan [region directory] [threads]
+*/
+
+typedef struct census_t {
+	uint64_t tags[13];
+	uint64_t largest; // Tags in the largest chunk
+	int largest_x, largest_z;
+} census;
+
+static uint64_t countTags(tag t, uint64_t* tags) {
+	uint64_t count = 1;
+	tags[t.id]++;
+	if(t.id == 9)
+		for(uint32_t i = 0; i < t.length; i++)
+			count += countTags(t.payload.asList[i], tags);
+	if(t.id == 10)
+		for(uint32_t i = 0; i < t.length; i++)
+			count += countTags(t.payload.asCompound[i], tags);
+	return count;
+}
+
+static int countChunk(void* accumulator, tag chunk, int x, int z, void* context) {
+	census* c = accumulator;
+	uint64_t count = countTags(chunk, c->tags);
+	if(count > c->largest) {
+		c->largest = count;
+		c->largest_x = x;
+		c->largest_z = z;
+	}
+	return 0;
+}
+
+static void mergeCensus(void* result, const void* accumulator, void* context) {
+	census* out = result;
+	const census* c = accumulator;
+	for(int i = 0; i < 13; i++)
+		out->tags[i] += c->tags[i];
+	if(c->largest > out->largest) {
+		out->largest = c->largest;
+		out->largest_x = c->largest_x;
+		out->largest_z = c->largest_z;
+	}
+}
+
+static double seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** args) {
+	const char* directory = argc > 1 ? args[1] : "region";
+	nbt_scan scan = {
+		.chunk = countChunk,
+		.merge = mergeCensus,
+		.accumulator_size = sizeof(census),
+		.threads = argc > 2 ? atoi(args[2]) : 0,
+		.flags = NBT_READ_BORROW,
+	};
+	census result = {0};
+	double start = seconds();
+	if(nbtScanWorld(directory, &scan, &result) != NBT_OK) {
+		printf("Could not scan %s\n", directory);
+		return 1;
+	}
+	double time = seconds() - start;
+
+	static const char* names[13] = {"end", "byte", "short", "int", "long", "float", "double", "byte array", "string", "list", "compound", "int array", "long array"};
+	printf("%s: %zu chunks, %zu unreadable, %.3f s\n", directory, scan.chunks, scan.failed, time);
+	for(int i = 1; i < 13; i++)
+		printf("%-12s %llu\n", names[i], (unsigned long long)result.tags[i]);
+	if(result.largest)
+		printf("largest chunk: %d, %d with %llu tags\n", result.largest_x, result.largest_z, (unsigned long long)result.largest);
+}